@@ -0,0 +1,119 @@
+// Plays many headless battles at the same time for tuning the unit constants and writes the outcome of every battle
+// as CSV. Every combination of the constants is played with seeds seed, seed + 1, ... seed + battles - 1
+//
+// usage: pp2_batch [--battles 100] [--seed 1] [--tanks 2558] [--frames 2000] [--rocket-hit 60,80]
+//                  [--max-speed 1.5,2] [--formation scatter] [--threads N] [--threads-per-battle 1] [--out batch.csv]
+//
+// --formation lines the armies up with a formation of Formation.h, the default scatter spawns them from the seed so
+//             every seed plays another battle, block is the layout of the game
+// --threads-per-battle splits the threads over the battles, 1 gives the most battles per second for small armies,
+//             more only pays off once a single battle is large enough to keep several threads busy
+
+#include "Batch.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace PP2;
+using namespace std;
+
+template <class T>
+static vector<T> ParseList(const char* in)
+{
+    vector<T> out;
+    stringstream ss(in);
+    string item;
+    while (getline(ss, item, ','))
+        if (!item.empty()) out.push_back((T)stod(item));
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    int battles = 100;
+    long long seed = 1;
+    int tanks = NUM_TANKS_BLUE + NUM_TANKS_RED;
+    int frames = MAX_FRAMES;
+    vector<int> rocketHits = {ROCKET_HIT_VALUE};
+    vector<float> maxSpeeds = {TANK_MAX_SPEED};
+    string formation = "scatter";
+    int threads = 0;
+    int threadsPerBattle = 1;
+    string outFile = "batch.csv";
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            cerr << "missing value for " << argv[i] << endl;
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--battles"))
+            battles = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed"))
+            seed = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tanks"))
+            tanks = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--frames"))
+            frames = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rocket-hit"))
+            rocketHits = ParseList<int>(argv[i + 1]);
+        else if (!strcmp(argv[i], "--max-speed"))
+            maxSpeeds = ParseList<float>(argv[i + 1]);
+        else if (!strcmp(argv[i], "--formation"))
+            formation = argv[i + 1];
+        else if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads-per-battle"))
+            threadsPerBattle = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--out"))
+            outFile = argv[i + 1];
+        else
+        {
+            cerr << "unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    if (!formation.empty() && !NamedFormation(formation, BLUE))
+    {
+        cerr << "unknown formation " << formation << endl;
+        return 1;
+    }
+
+    vector<BattleConfig> configs;
+    for (int rocketHit : rocketHits)
+        for (float maxSpeed : maxSpeeds)
+            for (int b = 0; b < battles; ++b)
+            {
+                BattleConfig config;
+                config.seed = seed + b;
+                config.num_blue = tanks / 2;
+                config.num_red = tanks - tanks / 2;
+                config.max_frames = frames;
+                config.parameters.rocket_hit_value = rocketHit;
+                config.parameters.tank_max_speed = maxSpeed;
+                config.formation = formation == "block" ? "" : formation;
+                configs.push_back(config);
+            }
+
+    BatchRunner runner(threads, threadsPerBattle);
+    cerr << configs.size() << " battles on " << runner.Slots() << " slot(s) of " << threadsPerBattle << " thread(s)" << endl;
+
+    mutex progressMutex;
+    size_t done = 0;
+    timer run;
+    auto results = runner.Run(configs, [&](const BattleResult&) {
+        scoped_lock lock(progressMutex);
+        if (++done % 10 == 0 || done == configs.size()) cerr << "\r" << done << "/" << configs.size() << flush;
+    });
+    float seconds = run.elapsed() / 1000.f;
+    cerr << endl;
+
+    cout << configs.size() << " battles in " << seconds << " s, " << configs.size() / seconds << " battles/s" << endl;
+    return BatchRunner::WriteResults(outFile, results) ? 0 : 1;
+}
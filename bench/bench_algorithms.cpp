@@ -0,0 +1,68 @@
+#include "Algorithms.h"
+#include "bench_util.h"
+
+using namespace PP2;
+
+static void BM_CountSort(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state) benchmark::DoNotOptimize(CountSort(redTanks));
+
+    state.SetItemsProcessed(state.iterations() * redTanks.size());
+}
+BENCHMARK(BM_CountSort)->Apply(TankArgs);
+
+static void BM_KDTreeBuild(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state)
+    {
+        KD_Tree tree(redTanks);
+        benchmark::DoNotOptimize(&tree);
+    }
+
+    state.SetItemsProcessed(state.iterations() * redTanks.size());
+}
+BENCHMARK(BM_KDTreeBuild)->Apply(TankArgs);
+
+static void BM_KDTreeFindClosest(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+    KD_Tree tree(redTanks);
+
+    for (auto _ : state)
+        for (Tank* tank : blueTanks) benchmark::DoNotOptimize(tree.findClosestTank(tank));
+
+    state.SetItemsProcessed(state.iterations() * blueTanks.size());
+}
+BENCHMARK(BM_KDTreeFindClosest)->Apply(TankArgs);
+
+static void BM_IntersectsCircle(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+
+    // Same beams as Game::Init
+    std::vector<Rectangle2D> beams = {
+        {{SCRWIDTH / 2, SCRHEIGHT / 2}, {SCRWIDTH / 2 + 100, SCRHEIGHT / 2 + 50}},
+        {{80, 80}, {180, 130}},
+        {{1200, 600}, {1300, 650}}};
+
+    for (auto _ : state)
+    {
+        int hits = 0;
+        for (const Tank& tank : tanks)
+            for (const Rectangle2D& beam : beams) hits += beam.intersectsCircle(tank.position, tank.collision_radius);
+        benchmark::DoNotOptimize(hits);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size() * beams.size());
+}
+BENCHMARK(BM_IntersectsCircle)->Apply(TankArgs);
@@ -0,0 +1,88 @@
+#include "Algorithms.h"
+#include "bench_util.h"
+#include "rocket.h"
+
+using namespace PP2;
+
+static void BM_SeparateTanks(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state)
+    {
+        for (Tank& tank : tanks) SeparateTank(tank, BenchGrid());
+
+        // Throw the forces away so every iteration starts from the same state
+        for (Tank& tank : tanks) tank.force = vec2<>(0.f, 0.f);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+}
+BENCHMARK(BM_SeparateTanks)->Apply(TankArgs);
+
+static void BM_SeparateTanksPairs(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state)
+    {
+        SeparateTanks(BenchGrid());
+
+        for (Tank& tank : tanks) tank.force = vec2<>(0.f, 0.f);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+}
+BENCHMARK(BM_SeparateTanksPairs)->Apply(TankArgs);
+
+static void BM_CollideRockets(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    // One rocket per tank, fired by the other side from a few pixels away so roughly half of them hit
+    std::mt19937 rng(state.range(0));
+    std::uniform_real_distribution<float> offset(-30.f, 30.f);
+    std::vector<Rocket> rockets;
+    rockets.reserve(tanks.size());
+    for (const Tank& tank : tanks)
+    {
+        vec2<> position = tank.position + vec2<>(offset(rng), offset(rng));
+        rockets.emplace_back(position, vec2<>(0.f, 0.f), bench_rocket_radius, (tank.alliance == RED) ? BLUE : RED, nullptr);
+    }
+
+    for (auto _ : state)
+    {
+        int hits = 0;
+        for (Rocket& rocket : rockets)
+        {
+            rocket.active = true;
+            CollideRocket(rocket, BenchGrid(), [&](Tank*) { ++hits; });
+        }
+        benchmark::DoNotOptimize(hits);
+    }
+
+    state.SetItemsProcessed(state.iterations() * rockets.size());
+}
+BENCHMARK(BM_CollideRockets)->Apply(TankArgs);
+
+static void BM_BinRockets(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    std::vector<Rocket> rockets;
+    rockets.reserve(tanks.size());
+    for (const Tank& tank : tanks) rockets.emplace_back(tank.position, vec2<>(0.f, 0.f), bench_rocket_radius, tank.alliance, nullptr);
+
+    for (auto _ : state) BenchGrid().BinRockets(rockets);
+
+    state.SetItemsProcessed(state.iterations() * rockets.size());
+}
+BENCHMARK(BM_BinRockets)->Apply(TankArgs);
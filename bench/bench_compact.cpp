@@ -0,0 +1,53 @@
+#include "Algorithms.h"
+#include "CompactTank.h"
+#include "bench_util.h"
+#include <tbb/parallel_for.h>
+
+using namespace PP2;
+
+// One frame of tank movement on the full Tank: separation, beams and Tick, like the tank loop of Game
+static void BM_MoveArmy_Tank(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    std::vector<Particle_beam> beams;
+    beams.emplace_back(vec2<>(SCRWIDTH / 2, SCRHEIGHT / 2), vec2<>(100, 50), nullptr, PARTICLE_BEAM_HIT_VALUE);
+
+    for (auto _ : state)
+    {
+        tbb::parallel_for(tbb::blocked_range<int>(0, tanks.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i)
+            {
+                Tank& tank = tanks[i];
+                if (!tank.active) continue;
+
+                SeparateTank(tank, BenchGrid());
+                for (Particle_beam& beam : beams)
+                    if (beam.rectangle.intersectsCircle(tank.Get_Position(), tank.Get_collision_radius())) tank.hit(beam.damage);
+                tank.Tick(BenchGrid());
+            }
+        });
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+    state.counters["bytes_per_tank"] = sizeof(Tank);
+}
+BENCHMARK(BM_MoveArmy_Tank)->Apply(TankArgs)->UseRealTime();
+
+// The same frame on CompactTank
+static void BM_MoveArmy_Compact(benchmark::State& state)
+{
+    CompactArmy army;
+    army.Pack(SpawnTanks(state.range(0), (Distribution)state.range(1)));
+
+    std::vector<Particle_beam> beams;
+    beams.emplace_back(vec2<>(SCRWIDTH / 2, SCRHEIGHT / 2), vec2<>(100, 50), nullptr, PARTICLE_BEAM_HIT_VALUE);
+
+    for (auto _ : state) army.Step(beams);
+
+    state.SetItemsProcessed(state.iterations() * army.Size());
+    state.counters["bytes_per_tank"] = (double)army.Bytes() / army.Size();
+}
+BENCHMARK(BM_MoveArmy_Compact)->Apply(TankArgs)->UseRealTime();
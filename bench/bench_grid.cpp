@@ -0,0 +1,34 @@
+#include "bench_util.h"
+
+using namespace PP2;
+
+// Moves a tank out of a crowded cell and back, the cost grows with the number of tanks in the cell
+static void BM_MoveTankToGridCell(benchmark::State& state)
+{
+    const int tanksPerCell = state.range(0);
+
+    std::vector<Tank> tanks;
+    tanks.reserve(tanksPerCell);
+    for (int i = 0; i < tanksPerCell; ++i)
+        tanks.emplace_back(500.f, 300.f, BLUE, nullptr, nullptr, 1200, 600, bench_tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
+
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    const vec2<int> home = tanks[0].gridCell;
+    const vec2<int> away(home.x + 1, home.y);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        Tank& tank = tanks[i++ % tanksPerCell];
+
+        BenchGrid().MoveTankToGridCell(&tank, away);
+        tank.gridCell = away;
+        BenchGrid().MoveTankToGridCell(&tank, home);
+        tank.gridCell = home;
+    }
+
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_MoveTankToGridCell)->ArgName("tanks_per_cell")->RangeMultiplier(4)->Range(1, 1024);
@@ -0,0 +1,144 @@
+#include "Algorithms.h"
+#include "Grid.h"
+#include "Partition.h"
+#include "ThreadPool.h"
+#include "bench_util.h"
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <thread>
+
+using namespace PP2;
+
+// One worker less than there are cores, the thread calling parallel_for helps
+static ThreadPool& Pool()
+{
+    static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+static void ResetForces(std::vector<Tank>& tanks)
+{
+    for (Tank& tank : tanks) tank.force = vec2<>(0.f, 0.f);
+}
+
+// The separation loop of Game::UpdateTanks, run through TBB and through ThreadPool
+static void BM_SeparateTanks_TBB(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state)
+    {
+        tbb::parallel_for(tbb::blocked_range<int>(0, tanks.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) SeparateTank(tanks[i], BenchGrid());
+        });
+        ResetForces(tanks);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+}
+BENCHMARK(BM_SeparateTanks_TBB)->Apply(TankArgs)->UseRealTime();
+
+// Same loop split by the neighbour count of every tank, the partition is rebuilt each iteration like in the game
+static void BM_SeparateTanks_CostPartition(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    Grid& grid = BenchGrid();
+    CostPartition partition;
+    size_t parts = 8 * (size_t)tbb::this_task_arena::max_concurrency();
+    for (auto _ : state)
+    {
+        partition.Build(tanks.size(), parts, [&](size_t i) { return 1 + grid.NeighbourCount(tanks[i].gridCell); });
+        ParallelFor(partition, [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) SeparateTank(tanks[i], BenchGrid());
+        });
+        ResetForces(tanks);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+}
+BENCHMARK(BM_SeparateTanks_CostPartition)->Apply(TankArgs)->UseRealTime();
+
+static void BM_SeparateTanks_ThreadPool(benchmark::State& state)
+{
+    auto tanks = SpawnTanks(state.range(0), (Distribution)state.range(1));
+    std::vector<Tank*> redTanks, blueTanks;
+    PopulateGrid(tanks, redTanks, blueTanks);
+
+    for (auto _ : state)
+    {
+        Pool().parallel_for(0, tanks.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) SeparateTank(tanks[i], BenchGrid());
+        });
+        ResetForces(tanks);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tanks.size());
+}
+BENCHMARK(BM_SeparateTanks_ThreadPool)->Apply(TankArgs)->UseRealTime();
+
+// Scheduling overhead of an empty loop with the default partitioning of both
+static void BM_EmptyLoop_TBB(benchmark::State& state)
+{
+    for (auto _ : state)
+        tbb::parallel_for(tbb::blocked_range<int>(0, state.range(0)), [](tbb::blocked_range<int> r) { benchmark::DoNotOptimize(r.begin()); });
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EmptyLoop_TBB)->Range(64, 16384)->UseRealTime();
+
+static void BM_EmptyLoop_ThreadPool(benchmark::State& state)
+{
+    for (auto _ : state)
+        Pool().parallel_for(0, state.range(0), [](size_t begin, size_t) { benchmark::DoNotOptimize(begin); });
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EmptyLoop_ThreadPool)->Range(64, 16384)->UseRealTime();
+
+// Independent tasks submitted from outside the pool, like the health bar sorts next to the tank update
+static void BM_Tasks_TBB(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        tbb::task_group group;
+        for (int i = 0; i < state.range(0); ++i) group.run([i] { benchmark::DoNotOptimize(i); });
+        group.wait();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Tasks_TBB)->Range(8, 4096)->UseRealTime();
+
+static void BM_Tasks_ThreadPool(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < state.range(0); ++i) futures.emplace_back(Pool().enqueue([i] { benchmark::DoNotOptimize(i); }));
+        for (auto& future : futures) future.wait();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Tasks_ThreadPool)->Range(8, 4096)->UseRealTime();
+
+static void BM_Tasks_ThreadPoolBulk(benchmark::State& state)
+{
+    std::vector<std::function<void()>> tasks;
+    for (int i = 0; i < state.range(0); ++i) tasks.emplace_back([i] { benchmark::DoNotOptimize(i); });
+
+    for (auto _ : state)
+    {
+        auto futures = Pool().enqueue_bulk(tasks.begin(), tasks.end());
+        for (auto& future : futures) future.wait();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Tasks_ThreadPoolBulk)->Range(8, 4096)->UseRealTime();
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Grid.h"
+#include "defines.h"
+#include "tank.h"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+namespace PP2
+{
+const float bench_tank_radius = 12.f;
+const float bench_rocket_radius = 10.f;
+
+/**
+ * Spatial layout of the tanks spawned for a benchmark
+ */
+enum Distribution
+{
+    FORMATION, // the block layout used by Game::Init
+    UNIFORM,   // spread evenly over the screen
+    CLUSTERED  // packed into a few dense hotspots
+};
+
+/**
+ * Spawn tanks with a fixed seed so every run measures the same battle
+ * @param count Number of tanks, half of them blue and half of them red
+ * @param distribution Spatial layout of the tanks
+ * @return The spawned tanks
+ */
+inline std::vector<Tank> SpawnTanks(int count, Distribution distribution)
+{
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> screenX(0.f, SCRWIDTH), screenY(0.f, SCRHEIGHT);
+    std::normal_distribution<float> spread(0.f, 20.f);
+    std::uniform_int_distribution<int> health(1, TANK_MAX_HEALTH);
+
+    std::vector<vec2<>> hotspots;
+    for (int i = 0; i < 8; ++i) hotspots.emplace_back(screenX(rng), screenY(rng));
+
+    std::vector<Tank> tanks;
+    tanks.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        alliances alliance = (i < count / 2) ? BLUE : RED;
+        int index = (alliance == BLUE) ? i : i - count / 2;
+
+        vec2<> position(0.f, 0.f);
+        switch (distribution)
+        {
+        case FORMATION:
+            position = (alliance == BLUE) ? vec2<>(24.f + (index % 12) * 15.f, 98.f + (index / 12) * 15.f)
+                                          : vec2<>(980.f + (index % 12) * 15.f, 100.f + (index / 12) * 15.f);
+            break;
+        case UNIFORM:
+            position = {screenX(rng), screenY(rng)};
+            break;
+        case CLUSTERED:
+            position = hotspots[i % hotspots.size()] + vec2<>(spread(rng), spread(rng));
+            break;
+        }
+
+        tanks.emplace_back(position.x, position.y, alliance, nullptr, nullptr, (alliance == BLUE) ? 1200 : 80,
+                           (alliance == BLUE) ? 600 : 80, bench_tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
+        tanks.back().health = health(rng);
+    }
+    return tanks;
+}
+
+/**
+ * The grid the benchmarks put their tanks in, one for the whole run like the grid of a single game
+ */
+inline Grid& BenchGrid()
+{
+    static Grid grid;
+    return grid;
+}
+
+/**
+ * Put the tanks in an empty grid and split them per alliance
+ */
+inline void PopulateGrid(std::vector<Tank>& tanks, std::vector<Tank*>& redTanks, std::vector<Tank*>& blueTanks)
+{
+    BenchGrid().Clear();
+    redTanks.clear();
+    blueTanks.clear();
+
+    for (auto& tank : tanks)
+    {
+        BenchGrid().AddTankToGridCell(&tank);
+        if (tank.alliance == RED)
+            redTanks.emplace_back(&tank);
+        else
+            blueTanks.emplace_back(&tank);
+    }
+}
+
+/**
+ * Argument sets shared by the benchmarks: { tank count, distribution }
+ */
+inline void TankArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"tanks", "distribution"});
+    for (int count : {256, 2558, 16384})
+        for (int distribution : {FORMATION, UNIFORM, CLUSTERED}) b->Args({count, distribution});
+}
+} // namespace PP2
@@ -0,0 +1,104 @@
+// Saves a battle to a checkpoint at a few frames, loads every checkpoint into a second game and plays both on: the
+// state hashes have to stay the same every frame
+//
+// usage: pp2_checkpoint [--at 0,300,1500] [--frames 300] [--tanks 2558] [--seed 1] [--neighbour-skin 0]
+//                       [--sort-interval 0] [--path round_trip.pp2c]
+//
+// Exits with 1 when a checkpoint does not load or a restored battle differs from the one it was saved from
+
+#include "game.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace PP2;
+using namespace std;
+
+static vector<int> ParseList(const char* in)
+{
+    vector<int> out;
+    stringstream ss(in);
+    string item;
+    while (getline(ss, item, ','))
+        if (!item.empty()) out.push_back(stoi(item));
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    vector<int> save_frames = {0, 300, 1500};
+    int frames = 300;
+    int tanks = NUM_TANKS_BLUE + NUM_TANKS_RED;
+    uint64_t seed = 1;
+    float skin = 0.f;
+    int sort_interval = 0;
+    string path = "round_trip.pp2c";
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            cerr << "missing value for " << argv[i] << endl;
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--at"))
+            save_frames = ParseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--frames"))
+            frames = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tanks"))
+            tanks = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed"))
+            seed = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "--neighbour-skin"))
+            skin = (float)atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--sort-interval"))
+            sort_interval = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--path"))
+            path = argv[i + 1];
+        else
+        {
+            cerr << "unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    auto setup = [&](Game& game) {
+        game.SetDeterministic(true, seed);
+        game.SetNeighbourSkin(skin);
+        game.SetSortInterval(sort_interval);
+        game.Init(tanks / 2, tanks - tanks / 2);
+    };
+
+    printf("%10s %10s %10s %s\n", "saved at", "blue", "red", "first divergent frame");
+
+    bool identical = true;
+    for (int at : save_frames)
+    {
+        Game original;
+        setup(original);
+        for (int f = 0; f < at; ++f) original.Step();
+
+        Game restored;
+        setup(restored);
+        if (!original.SaveCheckpoint(path) || !restored.LoadCheckpoint(path))
+        {
+            printf("%10d could not be saved and loaded\n", at);
+            identical = false;
+            continue;
+        }
+
+        long long divergent = original.HashState() == restored.HashState() ? -1 : at;
+        for (int f = 1; f <= frames && divergent == -1; ++f)
+        {
+            original.Step();
+            restored.Step();
+            if (original.HashState() != restored.HashState()) divergent = at + f;
+        }
+        identical = identical && divergent == -1;
+        printf("%10d %10zu %10zu %lld\n", at, original.ActiveTanks(BLUE), original.ActiveTanks(RED), divergent);
+    }
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Reads a replay written with --record and prints how the battle went
+//
+// usage: pp2_replay <file> [--every N]
+
+#include "Replay.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace PP2;
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cerr << "usage: pp2_replay <file> [--every N]" << endl;
+        return 1;
+    }
+
+    int every = 200;
+    for (int i = 2; i + 1 < argc; i += 2)
+        if (!strcmp(argv[i], "--every")) every = atoi(argv[i + 1]);
+    if (every < 1)
+    {
+        cerr << "--every needs a number of frames of at least 1" << endl;
+        return 1;
+    }
+
+    ReplayReader replay(argv[1]);
+    if (!replay.IsOpen())
+    {
+        cerr << "could not read " << argv[1] << endl;
+        return 1;
+    }
+
+    const uint8_t* alliances = replay.Alliances();
+
+    printf("%8s %10s %10s %10s %10s %10s\n", "frame", "blue", "red", "blue hp", "red hp", "rockets");
+
+    timer t;
+    long long rockets = 0;
+    for (size_t i = 0; i < replay.FrameCount(); ++i)
+    {
+        ReplayFrame frame = replay.GetFrame(i);
+        rockets += frame.rocket_count;
+
+        int alive[2] = {}, health[2] = {};
+        for (uint32_t tank = 0; tank < frame.tank_count; ++tank)
+        {
+            alive[alliances[tank]] += frame.tank_health[tank] > 0;
+            health[alliances[tank]] += frame.tank_health[tank];
+        }
+
+        if (i % every != 0 && i + 1 != replay.FrameCount()) continue;
+        printf("%8u %10d %10d %10d %10d %10lld\n", frame.frame, alive[BLUE], alive[RED], health[BLUE], health[RED], rockets);
+    }
+
+    float ms = t.elapsed();
+    printf("read %zu frames in %.1f ms (%.0f frames/sec)\n", replay.FrameCount(), ms, replay.FrameCount() / (ms / 1000.f));
+    return 0;
+}
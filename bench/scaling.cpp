@@ -0,0 +1,154 @@
+// Runs the simulation headless for a fixed number of frames over a matrix of thread counts and army sizes
+// and writes frames/sec, the time per phase and the parallel efficiency as CSV
+//
+// usage: pp2_scaling [--frames N] [--threads 1,2,4] [--tanks 2558,10000] [--out scaling.csv] [--counters]
+//                    [--deterministic seed] [--pin cores|nodes] [--numa] [--formation block|ring|wedge|scatter]
+//                    [--sort-every frames] [--skin pixels]
+//
+// --counters prints a table of hardware performance counters per phase to stderr after every run
+// --deterministic runs the deterministic mode, so every thread count simulates the same battle
+// --pin pins the worker threads, --numa also places the simulation data on the node of the threads using it
+// --formation lines both armies up in another formation than the default block
+// --sort-every reorders the tanks in memory by grid cell every few frames, compare with and without for large armies
+// --skin separates the tanks from neighbour lists with this skin instead of sweeping the grid every frame
+
+#include "PerfCounters.h"
+#include "game.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tbb/global_control.h>
+#include <thread>
+#include <vector>
+
+using namespace PP2;
+using namespace std;
+
+static vector<int> ParseList(const char* in)
+{
+    vector<int> out;
+    stringstream ss(in);
+    string item;
+    while (getline(ss, item, ','))
+        if (!item.empty()) out.push_back(stoi(item));
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = MAX_FRAMES;
+    vector<int> threads = {};
+    vector<int> armySizes = {NUM_TANKS_BLUE + NUM_TANKS_RED};
+    string outFile;
+    long long seed = -1;
+    Pinning pinning = Pinning::NONE;
+    bool numa = false;
+    string formation;
+    int sortEvery = 0;
+    float skin = 0.f;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--counters"))
+        {
+            PerfCounters::Instance()->Enable();
+            --i;
+        }
+        else if (!strcmp(argv[i], "--numa"))
+        {
+            numa = true;
+            --i;
+        }
+        else if (i + 1 == argc)
+        {
+            cerr << "missing value for " << argv[i] << endl;
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--frames"))
+            frames = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads"))
+            threads = ParseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tanks"))
+            armySizes = ParseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--out"))
+            outFile = argv[i + 1];
+        else if (!strcmp(argv[i], "--deterministic"))
+            seed = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "--pin"))
+            pinning = !strcmp(argv[i + 1], "nodes") ? Pinning::NODES : Pinning::CORES;
+        else if (!strcmp(argv[i], "--formation"))
+            formation = argv[i + 1];
+        else if (!strcmp(argv[i], "--sort-every"))
+            sortEvery = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--skin"))
+            skin = (float)atof(argv[i + 1]);
+        else
+        {
+            cerr << "unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    // Default to powers of two up to the number of hardware threads
+    if (threads.empty())
+    {
+        int hw = max(1u, thread::hardware_concurrency());
+        for (int t = 1; t < hw; t *= 2) threads.push_back(t);
+        threads.push_back(hw);
+    }
+    sort(threads.begin(), threads.end());
+
+    ofstream file;
+    if (!outFile.empty()) file.open(outFile);
+    ostream& out = outFile.empty() ? cout : file;
+
+    out << "threads,tanks,frames,seconds,fps,speedup,efficiency";
+    for (const char* name : PhaseNames) out << "," << name << "_ms";
+    out << "\n";
+
+    for (int tanks : armySizes)
+    {
+        // Speedup and efficiency are relative to the smallest thread count
+        float baseFps = 0.f;
+
+        for (int t : threads)
+        {
+            tbb::global_control control(tbb::global_control::max_allowed_parallelism, t);
+
+            auto game = make_unique<Game>();
+            if (seed >= 0) game->SetDeterministic(true, seed);
+            if (pinning != Pinning::NONE || numa) game->SetPlacement(pinning, numa);
+            game->SetSortInterval(sortEvery);
+            game->SetNeighbourSkin(skin);
+            if (!formation.empty())
+                game->SetFormations(NamedFormation(formation, BLUE, seed >= 0 ? seed : 0),
+                                    NamedFormation(formation, RED, seed >= 0 ? seed : 0));
+            game->Init(tanks / 2, tanks - tanks / 2);
+
+            timer run;
+            for (int f = 0; f < frames; ++f) game->Step();
+            float seconds = run.elapsed() / 1000.f;
+
+            float fps = frames / seconds;
+            if (baseFps == 0.f) baseFps = fps;
+            float speedup = fps / baseFps * threads.front();
+
+            out << t << "," << tanks << "," << frames << "," << seconds << "," << fps << "," << speedup << "," << speedup / t;
+            for (int p = 0; p < PHASE_COUNT; ++p) out << "," << game->GetPhaseTimer().Total((Phase)p) / frames;
+            out << endl;
+
+            if (PerfCounters::Enabled())
+            {
+                cerr << "threads " << t << ", tanks " << tanks << endl;
+                PerfCounters::Instance()->Print(cerr);
+                PerfCounters::Instance()->Reset();
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Plays one battle split over several processes and checks it against the same battle in one process: every run
+// writes a hash of the battle state every few frames and the first frame where they differ is reported
+//
+// usage: pp2_strips [--processes 1,2,4] [--tanks 2558] [--frames 2000] [--seed 1] [--hash-every 10]
+//                   [--threads-per-process 1] [--ring-bytes 1048576]
+//
+// The hash files are left behind as strips_<processes>.hash and strips_reference.hash
+// Exits with 1 when any run differs from the single process battle
+
+#include "Strips.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace PP2;
+using namespace std;
+
+static vector<int> ParseList(const char* in)
+{
+    vector<int> out;
+    stringstream ss(in);
+    string item;
+    while (getline(ss, item, ','))
+        if (!item.empty()) out.push_back(stoi(item));
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    vector<int> processes = {1, 2, 4};
+    StripConfig config;
+    config.seed = 1;
+    int tanks = NUM_TANKS_BLUE + NUM_TANKS_RED;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            cerr << "missing value for " << argv[i] << endl;
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--processes"))
+            processes = ParseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tanks"))
+            tanks = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--frames"))
+            config.frames = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed"))
+            config.seed = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "--hash-every"))
+            config.hash_every = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads-per-process"))
+            config.threads_per_process = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--ring-bytes"))
+            config.ring_bytes = atoll(argv[i + 1]);
+        else
+        {
+            cerr << "unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+    config.num_blue = tanks / 2;
+    config.num_red = tanks - tanks / 2;
+
+    //The strip runs fork, so they go first: the reference run starts the TBB threads of this process
+    vector<float> times;
+    for (int p : processes)
+    {
+        config.processes = p;
+        config.hash_path = "strips_" + to_string(p) + ".hash";
+        float seconds = 0.f;
+        if (!RunStrips(config, &seconds)) return 1;
+        times.push_back(seconds);
+    }
+
+    Game reference;
+    reference.SetDeterministic(true, config.seed);
+    reference.SetParameters(config.parameters);
+    reference.Init(config.num_blue, config.num_red);
+    reference.StartHashing("strips_reference.hash", config.hash_every);
+    timer run;
+    for (int f = 0; f < config.frames; ++f) reference.Step();
+    float referenceSeconds = run.elapsed() / 1000.f;
+    reference.Shutdown();
+
+    printf("%-10s %10s %10s %10s %s\n", "processes", "seconds", "speedup", "compared", "first divergent frame");
+    printf("%-10s %10.3f %10s %10s\n", "reference", referenceSeconds, "1.00", "-");
+
+    bool identical = true;
+    for (size_t i = 0; i < processes.size(); ++i)
+    {
+        size_t compared = 0;
+        long long divergent = FirstDivergentFrame("strips_reference.hash", "strips_" + to_string(processes[i]) + ".hash", &compared);
+        identical = identical && divergent == -1 && compared > 0;
+        printf("%-10d %10.3f %10.2f %10zu %lld\n", processes[i], times[i], referenceSeconds / times[i], compared, divergent);
+    }
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include "Affinity.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace PP2
+{
+//Parses a sysfs cpu list like "0-3,8-11"
+static vector<int> ParseCpuList(const string& list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        int first = stoi(item.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+Topology Topology::Detect()
+{
+    Topology topology;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for (int node = 0;; ++node)
+    {
+        ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!in) break;
+
+        string list;
+        getline(in, list);
+        vector<int> cpus;
+        for (int cpu : ParseCpuList(list))
+            if (!restricted || CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+        if (!cpus.empty()) topology.nodes.push_back(cpus);
+    }
+#endif
+    if (topology.nodes.empty())
+    {
+        vector<int> cpus(max(1u, thread::hardware_concurrency()));
+        for (size_t i = 0; i < cpus.size(); ++i) cpus[i] = (int)i;
+        topology.nodes.push_back(cpus);
+    }
+    return topology;
+}
+
+size_t Topology::CoreCount() const
+{
+    size_t count = 0;
+    for (const auto& node : nodes) count += node.size();
+    return count;
+}
+
+size_t Topology::NodeOfSlot(int slot, int slots) const
+{
+    return min(nodes.size() - 1, (size_t)slot * nodes.size() / (size_t)max(slots, 1));
+}
+
+bool PinCurrentThread(const vector<int>& cores)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) CPU_SET(core, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int core : cores)
+        if (core < 64) mask |= DWORD_PTR(1) << core;
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+AffinityObserver::AffinityObserver(Pinning pinning, Topology topology)
+    : pinning(pinning), topology(move(topology))
+{
+    for (const auto& node : this->topology.nodes) cores.insert(cores.end(), node.begin(), node.end());
+    if (pinning != Pinning::NONE) observe(true);
+}
+
+void AffinityObserver::on_scheduler_entry(bool)
+{
+    int slot = tbb::this_task_arena::current_thread_index();
+    if (slot < 0) return;
+
+    bool pinned;
+    if (pinning == Pinning::CORES)
+        pinned = PinCurrentThread({cores[slot % cores.size()]});
+    else
+    {
+        //A global_control limit leaves the arena size as it was, the threads only fill the first slots
+        int slots = min<int>(tbb::this_task_arena::max_concurrency(),
+                             (int)tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism));
+        pinned = PinCurrentThread(topology.nodes[topology.NodeOfSlot(slot, slots)]);
+    }
+
+    //Say it once, not once for every thread
+    if (!pinned && !failed.exchange(true)) cout << "Could not pin threads to cores, running unpinned" << endl;
+}
+
+void FirstTouch(void* data, size_t item_size, const CostPartition& partition)
+{
+    const uintptr_t page = 4096;
+    auto base = reinterpret_cast<uintptr_t>(data);
+
+    ParallelFor(partition, [&](tbb::blocked_range<int> r) {
+        //Every page is written by the range its first byte is in, so no two threads write the same page
+        uintptr_t end = base + r.end() * item_size;
+        for (uintptr_t address = (base + r.begin() * item_size + page - 1) & ~(page - 1); address < end; address += page)
+            *reinterpret_cast<volatile unsigned char*>(address) = 0;
+    });
+}
+} // namespace PP2
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Partition.h"
+#include <atomic>
+#include <tbb/task_scheduler_observer.h>
+#include <vector>
+
+namespace PP2
+{
+enum class Pinning
+{
+    NONE,
+    CORES, // every thread slot on its own core
+    NODES  // every thread slot on any core of one NUMA node
+};
+
+/**
+ * The cores of every NUMA node the process may run on, read from sysfs on Linux
+ * Elsewhere, or when sysfs is not there, all cores are one node
+ */
+struct Topology
+{
+    std::vector<std::vector<int>> nodes;
+
+    static Topology Detect();
+
+    size_t CoreCount() const;
+
+    /**
+     * The slots of an arena are split over the nodes in equal blocks in order, so slot 0 and the first ranges
+     * of a static schedule are on node 0
+     */
+    size_t NodeOfSlot(int slot, int slots) const;
+};
+
+/**
+ * Pin the calling thread to a set of cores
+ * @return False when the platform does not support it or the cores are not available
+ */
+bool PinCurrentThread(const std::vector<int>& cores);
+
+/**
+ * Pins every thread that joins the TBB arena by its slot, so the thread running slot i runs on the same cores
+ * every frame and a static schedule gives it the same ranges every frame
+ */
+class AffinityObserver : public tbb::task_scheduler_observer
+{
+  public:
+    AffinityObserver(Pinning pinning, Topology topology);
+
+    ~AffinityObserver() { observe(false); }
+
+    void on_scheduler_entry(bool is_worker) override;
+
+  private:
+    Pinning pinning;
+    Topology topology;
+    std::vector<int> cores; // every core, node by node
+    std::atomic<bool> failed{false};
+};
+
+/**
+ * Write every page of data from the thread that will work on it, so the OS places the page on that thread's node
+ * Call on memory nothing has written yet, like the capacity of a freshly reserved vector
+ * @param partition Static partition over the items, page i goes to the range holding the item it starts in
+ */
+void FirstTouch(void* data, size_t item_size, const CostPartition& partition);
+} // namespace PP2
@@ -1,5 +1,7 @@
 #include "Algorithms.h"
 #include <cmath>
+#include <functional>
+#include <tbb/parallel_for.h>
 
 #ifdef USING_EASY_PROFILER
 #include <easy/profiler.h>
@@ -9,11 +11,14 @@ using namespace std;
 
 namespace PP2
 {
-vector<int> CountSort(const vector<Tank*>& in)
+vector<int> CountSort(const vector<Tank*>& in, size_t count)
 {
     vector<int> Counters(TANK_MAX_HEALTH + 1, 0);
     vector<int> Results;
 
+    //The tanks that left the list were destroyed
+    Counters[0] = (int)(std::max(count, in.size()) - in.size());
+
     for (auto x : in)
         Counters.at(x->health <= 0 ? 0 : x->health)++;
 
@@ -25,6 +30,96 @@ vector<int> CountSort(const vector<Tank*>& in)
     return Results;
 }
 
+void SeparateTank(Tank& tank, const Grid& grid)
+{
+    for (const auto& cell : Grid::GetNeighbouringCells())
+    {
+        int x = tank.gridCell.x + cell.x;
+        int y = tank.gridCell.y + cell.y;
+        if (x < 0 || y < 0 || x > GRID_SIZE || y > GRID_SIZE) continue;
+
+        for (auto& oTank : grid.grid[x][y])
+        {
+            if (&tank == oTank) continue;
+
+            vec2<> dir = tank.Get_Position() - oTank->Get_Position();
+
+            float colSquaredLen =
+                (tank.Get_collision_radius() * tank.Get_collision_radius()) +
+                (oTank->Get_collision_radius() * oTank->Get_collision_radius());
+
+            if (dir.sqrLength() < colSquaredLen) tank.Push(dir.normalized(), 1.f);
+        }
+    }
+}
+
+void SeparateColumn(Grid& grid, int x, int first_column, int end_column)
+{
+    //The other half of the cells around a cell sees this cell as one of its forward cells
+    static const vec2<int> forward[] = {{0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+    auto pushed = [&](int column) { return column >= first_column && column < end_column; };
+
+    for (int y = 0; y <= GRID_SIZE; ++y)
+    {
+        auto& cell = grid.grid[x][y];
+        for (size_t i = 0; i < cell.size(); ++i)
+        {
+            Tank& tank = *cell[i];
+            if (!tank.active) continue;
+
+            bool push = pushed(x);
+            float radius = tank.Get_collision_radius() * tank.Get_collision_radius();
+
+            //The pushes of this tank are added up here and applied once
+            vec2<> force(0.f, 0.f);
+            auto separate = [&](Tank* oTank, bool oPushed) {
+                if (!oTank->active || (!push && !oPushed)) return;
+
+                vec2<> dir = tank.Get_Position() - oTank->Get_Position();
+                float colSquaredLen = radius + (oTank->Get_collision_radius() * oTank->Get_collision_radius());
+                if (dir.sqrLength() >= colSquaredLen) return;
+
+                vec2<> direction = dir.normalized();
+                force += direction;
+                if (oPushed) oTank->Push(-direction, 1.f);
+            };
+
+            for (size_t j = i + 1; j < cell.size(); ++j) separate(cell[j], pushed(x));
+
+            for (const vec2<int>& offset : forward)
+            {
+                int oX = x + offset.x;
+                int oY = y + offset.y;
+                if (oY < 0 || oX > GRID_SIZE || oY > GRID_SIZE) continue;
+
+                bool oPushed = pushed(oX);
+                for (Tank* oTank : grid.grid[oX][oY]) separate(oTank, oPushed);
+            }
+
+            if (push) tank.Push(force, 1.f);
+        }
+    }
+}
+
+void SeparateTanks(Grid& grid, int first_column, int end_column)
+{
+    //The column before the first one holds the tanks that pair with the first column
+    int begin = std::max(first_column - 1, 0);
+    for (int parity = 0; parity < 2; ++parity)
+    {
+        int first = begin + ((begin & 1) != parity);
+        if (first >= end_column) continue;
+
+        tbb::parallel_for(
+            tbb::blocked_range<int>(0, (end_column - first + 1) / 2, 1),
+            [&](tbb::blocked_range<int> r) {
+                for (int i = r.begin(); i < r.end(); ++i) SeparateColumn(grid, first + 2 * i, first_column, end_column);
+            },
+            tbb::simple_partitioner());
+    }
+}
+
 template <class T>
 void LinkedList<T>::InsertValue(T value)
 {
@@ -178,6 +273,52 @@ Tank* KD_Tree::searchNN(KD_node* currentNode, Tank* target, Rectangle2D& hyperpl
         closestTank = searchNN(furthestNode, target, furthestHyperplane, distanceCurrentClosestTank, currentClosestTank, depth + 1);
     return closestTank;
 }
+vector<Tank*> KD_Tree::nodes() const
+{
+    vector<Tank*> out;
+    vector<KD_node*> stack = {root};
+    while (!stack.empty())
+    {
+        KD_node* node = stack.back();
+        stack.pop_back();
+        out.emplace_back(node ? node->tank : nullptr);
+        if (node == nullptr) continue;
+
+        //Left is popped first
+        stack.emplace_back(node->right);
+        stack.emplace_back(node->left);
+    }
+    return out;
+}
+
+KD_Tree* KD_Tree::fromNodes(const vector<Tank*>& nodes)
+{
+    size_t next = 0;
+    function<KD_node*()> build = [&]() -> KD_node* {
+        if (next >= nodes.size() || nodes[next] == nullptr)
+        {
+            ++next;
+            return nullptr;
+        }
+
+        auto* node = new KD_node(nodes[next++]);
+        node->left = build();
+        node->right = build();
+        return node;
+    };
+
+    auto* tree = new KD_Tree();
+    tree->root = build();
+
+    //Every entry has to belong to the one tree, a list cut short or with entries left over is not one
+    if (next != nodes.size())
+    {
+        delete tree;
+        return nullptr;
+    }
+    return tree;
+}
+
 float KD_Tree::calculateCurrentClosest(float targetXY, float hyperplaneMinXY, float hyperplaneMaxXY)
 {
     float value = 0;
@@ -110,6 +110,17 @@ class KD_Tree
      */
     Tank* findClosestTank(Tank* tank);
 
+    /**
+     * The tanks of every node in pre-order, nullptr marks an empty branch
+     */
+    std::vector<Tank*> nodes() const;
+
+    /**
+     * Rebuild the exact tree returned by nodes, so a restored game targets the same tanks
+     * @return nullptr when the nodes are not exactly one tree
+     */
+    static KD_Tree* fromNodes(const std::vector<Tank*>& nodes);
+
     void printTree()
     {
         auto pFile = fopen("./TreeDebug.dot", "w");
@@ -118,6 +129,8 @@ class KD_Tree
     };
 
   private:
+    KD_Tree() = default;
+
     KD_node* root = nullptr;
     static KD_node* BuildKDTree(std::vector<Tank*> input, unsigned depth);
     static float calculateCurrentClosest(float targetXY, float hyperplaneMinXY, float hyperplaneMaxXY);
@@ -128,5 +141,60 @@ class KD_Tree
     static void bst_print_dot_null(const std::string& key, int nullCount, FILE* stream);
 };
 
-std::vector<int> CountSort(const std::vector<Tank*>& in);
+/**
+ * The health of every tank in ascending order
+ * @param count Size of the army, tanks that are missing from in count as destroyed
+ */
+std::vector<int> CountSort(const std::vector<Tank*>& in, size_t count = 0);
+
+/**
+ * Nudge a tank away from every tank it overlaps in its own and the surrounding grid cells
+ * @param tank The tank to push
+ * @param grid The grid the tank is in
+ */
+void SeparateTank(Tank& tank, const Grid& grid);
+
+/**
+ * Push every active tank away from the active tanks it overlaps, wrecks are passed through. Unlike SeparateTank every
+ * pair of tanks is checked once and both of them are pushed. Every column of cells is swept against itself and the column after it, first all even
+ * columns in parallel and then all odd ones, so no two tasks push tanks in the same column and the forces add up in
+ * the same order for any thread count
+ * @param first_column, end_column Only the tanks in these columns are pushed, the columns next to them are only read
+ */
+void SeparateTanks(Grid& grid, int first_column = 0, int end_column = GRID_SIZE + 1);
+
+/**
+ * The sweep of one column of SeparateTanks, it pushes the tanks of column x and x + 1 and nothing else. Once the
+ * columns x - 1 and x are swept the tanks of column x have all their pushes
+ */
+void SeparateColumn(Grid& grid, int x, int first_column = 0, int end_column = GRID_SIZE + 1);
+
+/**
+ * Check a rocket against the enemy tanks in its own and the surrounding grid cells
+ * @param rocket The rocket to check, deactivated when it hits a tank
+ * @param grid The grid of the game the rocket is in
+ * @param onHit Called with every tank the rocket hits
+ */
+template <class F>
+void CollideRocket(Rocket& rocket, const Grid& grid, F onHit)
+{
+    vec2<int> rocketGridCell = Grid::GetGridCell(rocket.position);
+    for (const auto& cell : Grid::GetNeighbouringCells())
+    {
+        int x = rocketGridCell.x + cell.x;
+        int y = rocketGridCell.y + cell.y;
+        if (x < 0 || y < 0 || x > GRID_SIZE || y > GRID_SIZE) continue;
+
+        for (auto& tank : grid.grid[x][y])
+        {
+            if (tank->active && (tank->alliance != rocket.allignment) &&
+                rocket.Intersects(tank->position, tank->collision_radius))
+            {
+                onHit(tank);
+                rocket.active = false;
+                break;
+            }
+        }
+    }
+}
 } // namespace PP2
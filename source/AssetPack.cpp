@@ -0,0 +1,314 @@
+#include "AssetPack.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <tbb/parallel_for.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PP2
+{
+static const char pack_magic[4] = {'P', 'P', '2', 'A'};
+static const uint32_t pack_version = 1;
+static const uint32_t chunk_rows = 64;
+//zlib never inflates a stream to more than this many times its size
+static const size_t max_inflate_ratio = 1032;
+
+/**
+ * A read only memory mapping of a whole file
+ */
+class MappedFile
+{
+  public:
+    explicit MappedFile(const string& path)
+    {
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        size = (size_t)file_size.QuadPart;
+
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_handle == nullptr) return;
+        data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) return;
+
+        struct stat st;
+        fstat(fd, &st);
+        size = (size_t)st.st_size;
+
+        if (size > 0)
+        {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) data = (const char*)mapped;
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data != nullptr) UnmapViewOfFile(data);
+        if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+#else
+        if (data != nullptr) munmap((void*)data, size);
+#endif
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+  private:
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+#endif
+};
+
+static uint32_t ChunkCount(const AssetPack::Image& image) { return ((uint32_t)image.height + chunk_rows - 1) / chunk_rows; }
+
+bool AssetPack::Load(const string& path)
+{
+    MappedFile file(path);
+    if (file.data == nullptr) return false;
+
+    const auto* header = reinterpret_cast<const AssetPackHeader*>(file.data);
+    if (file.size < sizeof(AssetPackHeader) || memcmp(header->magic, pack_magic, sizeof(pack_magic)) != 0 ||
+        header->version > pack_version || file.size < sizeof(AssetPackHeader) + header->asset_count * sizeof(AssetPackEntry))
+    {
+        cout << "Not an asset pack " << path << endl;
+        return false;
+    }
+
+    //Index every chunk first, so the decompression below is one flat parallel loop
+    struct Chunk
+    {
+        Image* image;
+        uint32_t first_row;
+        uint32_t rows;
+        const char* data;
+        uint32_t size;
+    };
+    vector<Chunk> chunks;
+    auto corrupt = [&]() {
+        cout << "Corrupt asset pack " << path << endl;
+        images.clear();
+        return false;
+    };
+
+    const auto* entries = reinterpret_cast<const AssetPackEntry*>(header + 1);
+    images.resize(header->asset_count);
+    for (uint32_t i = 0; i < header->asset_count; ++i)
+    {
+        const AssetPackEntry& entry = entries[i];
+        Image& image = images[i];
+        image.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+        image.width = entry.width;
+        image.height = entry.height;
+        image.blend = entry.blend != 0;
+
+        //The chunks have to cover every row, one chunk per chunk_rows rows
+        if (entry.chunk_rows == 0 || entry.chunk_count != ((uint64_t)entry.height + entry.chunk_rows - 1) / entry.chunk_rows)
+            return corrupt();
+
+        if (entry.offset > file.size || entry.chunk_count > (file.size - entry.offset) / sizeof(uint32_t))
+        {
+            cout << "Asset pack " << path << " is cut off" << endl;
+            images.clear();
+            return false;
+        }
+
+        const char* sizes = file.data + entry.offset;
+        size_t start = entry.offset + entry.chunk_count * sizeof(uint32_t);
+        size_t offset = start;
+        for (uint32_t c = 0; c < entry.chunk_count; ++c)
+        {
+            uint32_t size;
+            memcpy(&size, sizes + c * sizeof(uint32_t), sizeof(size));
+            uint32_t first_row = c * entry.chunk_rows;
+            if (size > file.size - offset)
+            {
+                cout << "Asset pack " << path << " is cut off" << endl;
+                images.clear();
+                return false;
+            }
+            chunks.push_back({&image, first_row, min(entry.chunk_rows, entry.height - first_row), file.data + offset, size});
+            offset += size;
+        }
+
+        //The chunks could not inflate to more pixels than this
+        if ((uint64_t)entry.width * entry.height > (offset - start) * max_inflate_ratio / sizeof(uint32_t)) return corrupt();
+        image.pixels.resize((size_t)entry.width * entry.height);
+    }
+
+    atomic<bool> ok{true};
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size(), 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t c = r.begin(); c < r.end(); ++c)
+        {
+            const Chunk& chunk = chunks[c];
+            Image& image = *chunk.image;
+            uLongf rows_size = (uLongf)chunk.rows * image.width * sizeof(uint32_t);
+            uLongf raw_size = rows_size;
+            Bytef* out = reinterpret_cast<Bytef*>(image.pixels.data() + (size_t)chunk.first_row * image.width);
+            if (uncompress(out, &raw_size, reinterpret_cast<const Bytef*>(chunk.data), chunk.size) != Z_OK || raw_size != rows_size) ok = false;
+        }
+    });
+
+    if (!ok) return corrupt();
+    return true;
+}
+
+bool AssetPack::LoadFiles(const vector<string>& paths)
+{
+    images.resize(paths.size());
+
+    atomic<bool> ok{true};
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, paths.size(), 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); ++i)
+        {
+            Image& image = images[i];
+            image.name = paths[i].substr(paths[i].find_last_of("/\\") + 1);
+
+            SDL_Surface* loaded = SDL_LoadBMP(paths[i].c_str());
+            SDL_Surface* surface = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0) : nullptr;
+            if (surface == nullptr)
+            {
+                cout << "Could not load " << paths[i] << endl;
+                ok = false;
+                SDL_FreeSurface(loaded);
+                continue;
+            }
+
+            image.width = surface->w;
+            image.height = surface->h;
+            image.blend = loaded->format->Amask != 0;
+            image.pixels.resize((size_t)surface->w * surface->h);
+            for (int y = 0; y < surface->h; ++y)
+                memcpy(image.pixels.data() + (size_t)y * surface->w, (const char*)surface->pixels + (size_t)y * surface->pitch,
+                       surface->w * sizeof(uint32_t));
+
+            SDL_FreeSurface(surface);
+            SDL_FreeSurface(loaded);
+        }
+    });
+    return ok;
+}
+
+bool AssetPack::Write(const string& path) const
+{
+    //Compress every chunk of every image in parallel, then write them in order
+    vector<vector<vector<Bytef>>> compressed(images.size());
+    for (size_t i = 0; i < images.size(); ++i) compressed[i].resize(ChunkCount(images[i]));
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, images.size(), 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); ++i)
+        {
+            const Image& image = images[i];
+            tbb::parallel_for(tbb::blocked_range<uint32_t>(0, ChunkCount(image), 1), [&](tbb::blocked_range<uint32_t> chunks) {
+                for (uint32_t c = chunks.begin(); c < chunks.end(); ++c)
+                {
+                    uint32_t rows = min<uint32_t>(chunk_rows, image.height - c * chunk_rows);
+                    uLong raw_size = (uLong)rows * image.width * sizeof(uint32_t);
+                    uLongf size = compressBound(raw_size);
+
+                    vector<Bytef>& out = compressed[i][c];
+                    out.resize(size);
+                    compress2(out.data(), &size, reinterpret_cast<const Bytef*>(image.pixels.data() + (size_t)c * chunk_rows * image.width),
+                              raw_size, Z_BEST_COMPRESSION);
+                    out.resize(size);
+                }
+            });
+        }
+    });
+
+    AssetPackHeader header = {};
+    memcpy(header.magic, pack_magic, sizeof(pack_magic));
+    header.version = pack_version;
+    header.asset_count = (uint32_t)images.size();
+
+    vector<AssetPackEntry> entries(images.size());
+    uint64_t offset = sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry);
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        AssetPackEntry& entry = entries[i];
+        strncpy(entry.name, images[i].name.c_str(), sizeof(entry.name) - 1);
+        entry.width = images[i].width;
+        entry.height = images[i].height;
+        entry.blend = images[i].blend;
+        entry.chunk_rows = chunk_rows;
+        entry.chunk_count = (uint32_t)compressed[i].size();
+        entry.offset = offset;
+
+        offset += entry.chunk_count * sizeof(uint32_t);
+        for (const auto& chunk : compressed[i]) offset += chunk.size();
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        cout << "Could not open asset pack " << path << endl;
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(entries.data(), sizeof(AssetPackEntry), entries.size(), file);
+    for (const auto& chunks : compressed)
+    {
+        for (const auto& chunk : chunks)
+        {
+            uint32_t size = (uint32_t)chunk.size();
+            fwrite(&size, sizeof(size), 1, file);
+        }
+        for (const auto& chunk : chunks) fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
+
+const AssetPack::Image* AssetPack::Find(const string& name) const
+{
+    for (const Image& image : images)
+        if (image.name == name) return &image;
+    return nullptr;
+}
+
+SDL_Texture* AssetPack::CreateTexture(SDL_Renderer* renderer, const string& name) const
+{
+    const Image* image = Find(name);
+    if (image == nullptr)
+    {
+        cout << "Missing asset " << name << endl;
+        return nullptr;
+    }
+
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, image->width, image->height);
+    if (texture == nullptr) return nullptr;
+
+    SDL_UpdateTexture(texture, nullptr, image->pixels.data(), image->width * sizeof(uint32_t));
+    //SDL_CreateTextureFromSurface does the same for surfaces with alpha
+    if (image->blend) SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
+} // namespace PP2
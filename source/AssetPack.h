@@ -0,0 +1,86 @@
+#pragma once
+
+#include <SDL2/SDL_render.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Asset pack layout:
+ *   AssetPackHeader
+ *   AssetPackEntry[asset_count]
+ *   per asset: uint32_t chunk_size[chunk_count], then the chunks
+ * The ARGB8888 pixels of an asset are split in chunks of chunk_rows rows of width * 4 bytes that are compressed on
+ * their own with zlib, so a large image like the background decompresses on every thread at once.
+ * Built from the BMPs by running the game with --build-asset-pack
+ */
+struct AssetPackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t asset_count;
+    uint32_t reserved;
+};
+
+struct AssetPackEntry
+{
+    char name[48]; // file name of the source image, zero terminated
+    uint32_t width;
+    uint32_t height;
+    uint32_t blend; // the source had an alpha channel
+    uint32_t chunk_rows;
+    uint32_t chunk_count;
+    uint32_t reserved;
+    uint64_t offset; // of the chunk sizes, from the start of the pack
+};
+
+/**
+ * Images as ARGB8888 pixels in memory, read from an asset pack or from the image files themselves.
+ * Needs no renderer, so the pixels can be ready before the window is, textures are created from them afterwards
+ */
+class AssetPack
+{
+  public:
+    struct Image
+    {
+        std::string name;
+        int width = 0;
+        int height = 0;
+        bool blend = false;
+        std::vector<uint32_t> pixels;
+    };
+
+    /**
+     * Map a pack and decompress all images in parallel
+     * @return False with a message on stdout when the pack is missing or damaged
+     */
+    bool Load(const std::string& path);
+
+    /**
+     * Load BMP files through SDL in parallel and convert them to ARGB8888, used to build a pack or when there is none
+     * @return False with a message on stdout when a file could not be loaded
+     */
+    bool LoadFiles(const std::vector<std::string>& paths);
+
+    /**
+     * Write the loaded images to a pack
+     */
+    bool Write(const std::string& path) const;
+
+    /**
+     * @param name File name of the source image without its directory
+     * @return nullptr when the image is not loaded
+     */
+    const Image* Find(const std::string& name) const;
+
+    /**
+     * Create a static texture with the pixels of an image, call on the thread that owns the renderer
+     */
+    SDL_Texture* CreateTexture(SDL_Renderer* renderer, const std::string& name) const;
+
+  private:
+    std::vector<Image> images;
+};
+} // namespace PP2
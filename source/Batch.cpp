@@ -0,0 +1,96 @@
+#include "Batch.h"
+#include "Formation.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <thread>
+
+using namespace std;
+
+namespace PP2
+{
+BatchRunner::BatchRunner(int threads, int threads_per_battle)
+    : threads(threads > 0 ? threads : max(1, (int)thread::hardware_concurrency())),
+      threads_per_battle(clamp(threads_per_battle, 1, this->threads))
+{
+}
+
+vector<BattleResult> BatchRunner::Run(const vector<BattleConfig>& battles, const function<void(const BattleResult&)>& on_done) const
+{
+    vector<BattleResult> results(battles.size());
+
+    //Every slot adds its own thread to the workers its arena asks for, so cap the workers at the threads that are left
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads);
+
+    //Battles differ a lot in length, so slots take the next battle when they are done instead of a fixed share
+    atomic<size_t> next{0};
+    vector<thread> slots;
+    for (int s = 0; s < Slots(); ++s)
+    {
+        slots.emplace_back([&] {
+            tbb::task_arena arena(threads_per_battle);
+            for (size_t b = next++; b < battles.size(); b = next++)
+            {
+                arena.execute([&] { results[b] = Play(battles[b]); });
+                if (on_done) on_done(results[b]);
+            }
+        });
+    }
+    for (thread& slot : slots) slot.join();
+
+    return results;
+}
+
+BattleResult BatchRunner::Play(const BattleConfig& battle)
+{
+    timer run;
+
+    Game game;
+    game.SetDeterministic(true, battle.seed);
+    game.SetParameters(battle.parameters);
+    if (!battle.formation.empty())
+        game.SetFormations(NamedFormation(battle.formation, BLUE, battle.seed), NamedFormation(battle.formation, RED, battle.seed));
+    game.Init(battle.num_blue, battle.num_red);
+
+    BattleResult result;
+    result.config = battle;
+    while (game.GetFrameCount() < battle.max_frames)
+    {
+        game.Step();
+        if (game.ActiveTanks(BLUE) == 0 || game.ActiveTanks(RED) == 0) break;
+    }
+
+    result.frames = game.GetFrameCount();
+    result.blue_survivors = game.ActiveTanks(BLUE);
+    result.red_survivors = game.ActiveTanks(RED);
+    result.draw = result.blue_survivors == result.red_survivors;
+    result.winner = result.blue_survivors > result.red_survivors ? BLUE : RED;
+    result.seconds = run.elapsed() / 1000.f;
+    return result;
+}
+
+bool BatchRunner::WriteResults(const string& path, const vector<BattleResult>& results)
+{
+    ofstream out(path);
+    if (!out)
+    {
+        cout << "Could not open " << path << endl;
+        return false;
+    }
+
+    out << "battle,seed,blue_tanks,red_tanks,formation,rocket_hit_value,tank_max_speed,winner,blue_survivors,red_survivors,frames,seconds\n";
+    for (size_t b = 0; b < results.size(); ++b)
+    {
+        const BattleResult& result = results[b];
+        const BattleConfig& config = result.config;
+        out << b << "," << config.seed << "," << config.num_blue << "," << config.num_red << ","
+            << (config.formation.empty() ? "block" : config.formation) << "," << config.parameters.rocket_hit_value << ","
+            << config.parameters.tank_max_speed << "," << (result.draw ? "draw" : result.winner == BLUE ? "blue" : "red") << ","
+            << result.blue_survivors << "," << result.red_survivors << "," << result.frames << "," << result.seconds << "\n";
+    }
+    return out.good();
+}
+} // namespace PP2
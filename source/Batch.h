@@ -0,0 +1,77 @@
+#pragma once
+
+#include "game.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * One battle of a batch, always played in the deterministic mode so its outcome does not depend on how many threads
+ * it got
+ */
+struct BattleConfig
+{
+    uint64_t seed = 0;
+    int num_blue = NUM_TANKS_BLUE;
+    int num_red = NUM_TANKS_RED;
+    int max_frames = MAX_FRAMES;
+    BattleParameters parameters;
+    //Lines both armies up with NamedFormation and the seed, empty keeps the default blocks
+    std::string formation;
+};
+
+struct BattleResult
+{
+    BattleConfig config;
+    //BLUE or RED, or the alliance with the most survivors when time ran out, draw when those are equal
+    bool draw = false;
+    alliances winner = BLUE;
+    size_t blue_survivors = 0;
+    size_t red_survivors = 0;
+    //Frame the last tank of the losing army died, max_frames when no army was wiped out
+    long long frames = 0;
+    float seconds = 0.f;
+};
+
+/**
+ * Runs many headless battles at the same time. The threads are split in slots of threads_per_battle threads, every
+ * slot plays one battle after the other in its own task arena, so small battles run one per thread and never pay for
+ * the synchronisation of the parallel loops, while large ones can still use several threads each
+ */
+class BatchRunner
+{
+  public:
+    /**
+     * @param threads Threads for the whole batch, 0 uses every hardware thread
+     * @param threads_per_battle Threads every battle runs its parallel loops on
+     */
+    BatchRunner(int threads, int threads_per_battle);
+
+    /**
+     * Play every battle to the end
+     * @param on_done Called after every battle, from the thread that played it, may be empty
+     * @return The results in the order of the battles
+     */
+    std::vector<BattleResult> Run(const std::vector<BattleConfig>& battles,
+                                  const std::function<void(const BattleResult&)>& on_done = {}) const;
+
+    /**
+     * Play one battle on the calling thread and the task arena it is in
+     */
+    static BattleResult Play(const BattleConfig& battle);
+
+    /**
+     * Write the results as CSV, one line per battle
+     */
+    static bool WriteResults(const std::string& path, const std::vector<BattleResult>& results);
+
+    int Slots() const { return threads / threads_per_battle; }
+
+  private:
+    int threads;
+    int threads_per_battle;
+};
+} // namespace PP2
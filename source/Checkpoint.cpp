@@ -0,0 +1,41 @@
+#include "Checkpoint.h"
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+namespace PP2
+{
+bool CheckpointWriter::Save(const string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        cout << "Could not open checkpoint file " << path << endl;
+        return false;
+    }
+
+    bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    fclose(file);
+    return written;
+}
+
+bool CheckpointReader::Load(const string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        cout << "Could not open checkpoint file " << path << endl;
+        return ok = false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    buffer.resize((size_t)ftell(file));
+    fseek(file, 0, SEEK_SET);
+
+    ok = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    offset = 0;
+    fclose(file);
+    return ok;
+}
+} // namespace PP2
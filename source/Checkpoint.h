@@ -0,0 +1,131 @@
+#pragma once
+
+#include "template.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Checkpoint file layout, written by Game::SaveCheckpoint:
+ *   CheckpointHeader
+ *   tanks, rockets, smokes, explosions and particle beams, field by field
+ *   int32_t red_tanks[red_count], int32_t blue_tanks[blue_count] (indices into the tanks)
+ *   per grid cell: uint32_t count, int32_t tanks[count]
+ *   per KD tree: uint32_t count, int32_t nodes[count] (pre-order, -1 marks an empty branch)
+ *   uint8_t has_neighbour_lists, followed by NeighbourList::Save when it is 1
+ * Sprites are not stored, they are assigned again when loading
+ */
+struct CheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    int64_t frame_count;
+    uint32_t tank_count;
+    uint32_t rocket_count;
+    uint32_t smoke_count;
+    uint32_t explosion_count;
+    uint32_t particle_beam_count;
+    uint32_t red_count;
+    uint32_t blue_count;
+    uint32_t reserved;
+};
+
+static const char checkpoint_magic[4] = {'P', 'P', '2', 'C'};
+static const uint32_t checkpoint_version = 3;
+
+/**
+ * Appends plain values to a buffer that is written to disk in one go
+ */
+class CheckpointWriter
+{
+  public:
+    template <class T>
+    void Write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+        size_t offset = buffer.size();
+        buffer.resize(offset + sizeof(T));
+        memcpy(buffer.data() + offset, &value, sizeof(T));
+    }
+
+    //vec2 has a destructor, so it is written one component at a time
+    template <class T>
+    void Write(const vec2<T>& value)
+    {
+        Write(value.x);
+        Write(value.y);
+    }
+
+    void Write(const Rectangle2D& value)
+    {
+        Write(value.min);
+        Write(value.max);
+    }
+
+    bool Save(const std::string& path) const;
+
+  private:
+    std::vector<char> buffer;
+};
+
+/**
+ * Reads plain values back from a checkpoint file, reading past the end fails the reader instead of the read
+ */
+class CheckpointReader
+{
+  public:
+    bool Load(const std::string& path);
+
+    template <class T>
+    T Read()
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read");
+        T value = {};
+        if (offset + sizeof(T) > buffer.size())
+        {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, buffer.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    template <class T>
+    void Read(T& value) { value = Read<T>(); }
+
+    template <class T>
+    void Read(vec2<T>& value)
+    {
+        Read(value.x);
+        Read(value.y);
+    }
+
+    void Read(Rectangle2D& value)
+    {
+        Read(value.min);
+        Read(value.max);
+    }
+
+    /**
+     * Check that count records of record_bytes each are left to read, fails the reader otherwise
+     * Call before sizing anything from a count in the file, so a damaged count cannot allocate more than the file holds
+     */
+    bool Fits(size_t count, size_t record_bytes)
+    {
+        if (ok && record_bytes != 0 && count > (buffer.size() - offset) / record_bytes) ok = false;
+        return ok;
+    }
+
+    bool Ok() const { return ok; }
+
+  private:
+    std::vector<char> buffer;
+    size_t offset = 0;
+    bool ok = false;
+};
+} // namespace PP2
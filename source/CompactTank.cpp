@@ -0,0 +1,161 @@
+#include "CompactTank.h"
+#include "Grid.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tbb/parallel_for.h>
+
+using namespace std;
+
+namespace PP2
+{
+const int CELLS = GRID_SIZE + 1;
+
+void CompactTank::SetPosition(const vec2<>& position)
+{
+    x = (int32_t)lrintf(position.x * ONE);
+    y = (int32_t)lrintf(position.y * ONE);
+
+    vec2<int> cell = Grid::GetGridCell(position);
+    cell_x = (uint8_t)cell.x;
+    cell_y = (uint8_t)cell.y;
+}
+
+void CompactArmy::Pack(const vector<Tank>& in)
+{
+    for (int a = BLUE; a <= RED; ++a)
+    {
+        auto first = find_if(in.begin(), in.end(), [&](const Tank& tank) { return tank.alliance == a; });
+        if (first == in.end()) continue;
+        alliance[a] = {first->target, first->max_speed, first->collision_radius, first->tank_sprite, first->smoke_sprite};
+    }
+
+    tanks.resize(in.size());
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        const Tank& tank = in[i];
+        CompactTank& packed = tanks[i];
+        packed.SetPosition(tank.position);
+        packed.health = (uint16_t)max(tank.health, 0);
+        packed.reload = tank.reloaded ? 0 : (uint8_t)max(tank.reload_time, 1.f);
+        packed.alliance = tank.alliance;
+        packed.active = tank.active;
+        packed.frame = tank.current_frame;
+    }
+}
+
+void CompactArmy::Unpack(vector<Tank>& out) const
+{
+    out.clear();
+    out.reserve(tanks.size());
+    for (const CompactTank& packed : tanks)
+    {
+        const Alliance& shared = alliance[packed.alliance];
+        vec2<> position = packed.Position();
+        out.emplace_back(position.x, position.y, (alliances)packed.alliance, shared.tank_sprite, shared.smoke_sprite,
+                         shared.target.x, shared.target.y, shared.collision_radius, packed.health, shared.max_speed);
+
+        Tank& tank = out.back();
+        tank.reloaded = packed.Reloaded();
+        tank.reload_time = packed.reload;
+        tank.active = packed.active;
+        tank.current_frame = packed.frame;
+    }
+}
+
+void CompactArmy::Spawn(const vec2<>& position, alliances side)
+{
+    CompactTank tank;
+    tank.SetPosition(position);
+    tank.health = TANK_MAX_HEALTH;
+    tank.reload = 1;
+    tank.alliance = side;
+    tank.active = true;
+    tank.frame = 0;
+    tanks.push_back(tank);
+}
+
+//Counting sort of the active tank indices by cell, so the tanks of a cell are contiguous and in index order. Wrecks
+//are left out, separation passes through them like SeparateTanks does
+void CompactArmy::SortByCell()
+{
+    cell_start.assign(CELLS * CELLS + 1, 0);
+    for (const CompactTank& tank : tanks)
+        if (tank.active) ++cell_start[tank.cell_x * CELLS + tank.cell_y + 1];
+    for (size_t c = 1; c < cell_start.size(); ++c) cell_start[c] += cell_start[c - 1];
+
+    cell_tanks.resize(cell_start.back());
+    cell_bodies.resize(cell_start.back());
+    vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+    for (uint32_t i = 0; i < tanks.size(); ++i)
+    {
+        const CompactTank& tank = tanks[i];
+        if (!tank.active) continue;
+
+        uint32_t k = fill[tank.cell_x * CELLS + tank.cell_y]++;
+        float radius = alliance[tank.alliance].collision_radius;
+        cell_tanks[k] = i;
+        cell_bodies[k] = {tank.x / CompactTank::ONE, tank.y / CompactTank::ONE, radius * radius};
+    }
+}
+
+size_t CompactArmy::Step(const vector<Particle_beam>& beams)
+{
+    SortByCell();
+
+    //Neighbours are read from the copy made by SortByCell, so the result does not depend on the order tanks move in
+    atomic<size_t> destroyed{0};
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, tanks.size()), [&](tbb::blocked_range<size_t> r) {
+        size_t killed = 0;
+        for (size_t i = r.begin(); i < r.end(); ++i)
+        {
+            CompactTank& tank = tanks[i];
+            if (!tank.active) continue;
+
+            const Alliance& shared = alliance[tank.alliance];
+            vec2<> position = tank.Position();
+            float squaredRadius = shared.collision_radius * shared.collision_radius;
+
+            //Nudge away from every overlapping active tank in the surrounding cells, see SeparateTank
+            vec2<> force(0.f, 0.f);
+            for (int x = max(tank.cell_x - 1, 0); x <= min(tank.cell_x + 1, GRID_SIZE); ++x)
+                for (int y = max(tank.cell_y - 1, 0); y <= min(tank.cell_y + 1, GRID_SIZE); ++y)
+                {
+                    int cell = x * CELLS + y;
+                    for (uint32_t k = cell_start[cell]; k < cell_start[cell + 1]; ++k)
+                    {
+                        if (cell_tanks[k] == i) continue;
+
+                        const Body& other = cell_bodies[k];
+                        vec2<> dir(position.x - other.x, position.y - other.y);
+                        if (dir.sqrLength() < squaredRadius + other.squared_radius) force += dir.normalized();
+                    }
+                }
+
+            for (const Particle_beam& beam : beams)
+            {
+                if (!beam.rectangle.intersectsCircle(position, shared.collision_radius)) continue;
+
+                //Health below zero is stored as zero
+                if (tank.health <= beam.damage)
+                {
+                    tank.health = 0;
+                    if (tank.active) ++killed;
+                    tank.active = false;
+                }
+                else
+                    tank.health -= beam.damage;
+            }
+
+            //Move towards the target, see Tank::Tick
+            vec2<> speed = (shared.target - position).normalized() + force;
+            tank.SetPosition(position + speed * shared.max_speed * 0.5f);
+            if (tank.reload > 0) --tank.reload;
+            tank.frame = tank.frame >= 8 ? 0 : tank.frame + 1;
+        }
+        destroyed += killed;
+    });
+
+    return destroyed;
+}
+} // namespace PP2
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "particle_beam.h"
+#include "tank.h"
+#include <cstdint>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * A tank in 16 bytes instead of the 120 of Tank, for armies of a million tanks and more
+ *
+ * Precision budget, against the full Tank:
+ *   position   16.16 fixed point: range +-32768 px, step 1/65536 px. Positions are rounded to the nearest step every
+ *              frame, so a tank drifts at most 1/131072 px per frame from the float path, 0.02 px over MAX_FRAMES
+ *   health     uint16_t: exact, the game only deals whole damage and TANK_MAX_HEALTH is far below 65535
+ *   reload     frames left until the next rocket: exact, Tank counts its float reload time down in whole frames
+ *              from 200, which fits a uint8_t
+ *   frame      4 bits for the 9 animation frames: exact
+ *   cell       a byte per axis for the 81 grid cells: exact
+ * Not stored at all:
+ *   speed      Tank::Tick recomputes it every frame from the target and the push forces
+ *   target, max_speed, collision_radius and the sprites are the same for every tank of an alliance and are kept
+ *   once per alliance by CompactArmy
+ */
+struct CompactTank
+{
+    int32_t x;
+    int32_t y;
+    uint16_t health;
+    uint8_t reload;
+    uint8_t alliance : 1;
+    uint8_t active : 1;
+    uint8_t frame : 4;
+    uint8_t cell_x;
+    uint8_t cell_y;
+
+    static constexpr float ONE = 65536.f;
+
+    vec2<> Position() const { return vec2<>(x / ONE, y / ONE); }
+
+    void SetPosition(const vec2<>& position);
+
+    bool Reloaded() const { return reload == 0; }
+};
+static_assert(sizeof(CompactTank) == 16, "CompactTank should stay 16 bytes");
+
+/**
+ * An army stored as CompactTank, with what every tank of an alliance shares stored once
+ */
+class CompactArmy
+{
+  public:
+    struct Alliance
+    {
+        vec2<> target;
+        float max_speed = TANK_MAX_SPEED;
+        float collision_radius = 12.f;
+        SDL_Texture* tank_sprite = nullptr;
+        SDL_Texture* smoke_sprite = nullptr;
+    };
+
+    /**
+     * Pack full tanks, the shared fields of every alliance are taken from its first tank
+     */
+    void Pack(const std::vector<Tank>& tanks);
+
+    /**
+     * Expand back into full tanks, in the same order
+     */
+    void Unpack(std::vector<Tank>& out) const;
+
+    /**
+     * Add a tank with full health and a loaded rocket next frame, like a freshly spawned Tank
+     */
+    void Spawn(const vec2<>& position, alliances alliance);
+
+    /**
+     * Move every active tank one frame on the packed form: nudge it away from the active tanks it overlaps, let the
+     * particle beams hit it, then move it towards its target and count down its reload. This models the tank loop of
+     * Game for measuring the packed layout and does not reproduce it: every tank is pushed by SeparateTank's rule from
+     * the positions at the start of the step, not by the column sweep of SeparateTanks, and positions are rounded to
+     * fixed point. Targeting and rockets need the full tanks and are not part of this
+     * @return The number of tanks destroyed by the beams
+     */
+    size_t Step(const std::vector<Particle_beam>& beams);
+
+    size_t Size() const { return tanks.size(); }
+
+    /**
+     * Memory held by the army, including what Step rebuilds every frame
+     */
+    size_t Bytes() const
+    {
+        return tanks.capacity() * sizeof(CompactTank) + cell_tanks.capacity() * sizeof(uint32_t) +
+               cell_bodies.capacity() * sizeof(Body);
+    }
+
+    std::vector<CompactTank> tanks;
+    Alliance alliance[2];
+
+  private:
+    struct Body
+    {
+        float x;
+        float y;
+        float squared_radius;
+    };
+
+    //Tank indices sorted by grid cell, rebuilt every step in place of the pointer lists of Grid, and the positions of
+    //this frame in the same order, so the neighbour checks read contiguous floats and the tanks can move in place
+    std::vector<uint32_t> cell_start;
+    std::vector<uint32_t> cell_tanks;
+    std::vector<Body> cell_bodies;
+
+    void SortByCell();
+};
+} // namespace PP2
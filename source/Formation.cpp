@@ -0,0 +1,68 @@
+#include "Formation.h"
+#include "Random.h"
+#include "defines.h"
+#include <cmath>
+
+using namespace std;
+
+namespace PP2
+{
+Formation BlockFormation(const vec2<>& start, int max_rows, float spacing)
+{
+    return [=](int index, int) {
+        return vec2<>(start.x + (index % max_rows) * spacing, start.y + (index / max_rows) * spacing);
+    };
+}
+
+Formation RingFormation(const vec2<>& center, float spacing)
+{
+    return [=](int index, int) {
+        if (index == 0) return center;
+
+        //Ring k starts at index 1 + 3k(k - 1), solve for k and correct the rounding of the square root
+        int k = (int)((3.0 + sqrt(12.0 * index - 3.0)) / 6.0);
+        while (1 + 3 * k * (k - 1) > index) --k;
+        while (1 + 3 * (k + 1) * k <= index) ++k;
+
+        float angle = 2.f * PI * (index - (1 + 3 * k * (k - 1))) / (6.f * k);
+        return center + vec2<>(cosf(angle), sinf(angle)) * (k * spacing);
+    };
+}
+
+Formation WedgeFormation(const vec2<>& tip, const vec2<>& direction, float spacing)
+{
+    vec2<> side(-direction.y, direction.x);
+    return [=](int index, int) {
+        //Row r starts at index r(r + 1) / 2
+        int r = (int)((sqrt(8.0 * index + 1.0) - 1.0) / 2.0);
+        while (r * (r + 1) / 2 > index) --r;
+        while ((r + 1) * (r + 2) / 2 <= index) ++r;
+
+        float across = (index - r * (r + 1) / 2) - r * 0.5f;
+        return tip - direction * (r * spacing) + side * (across * spacing);
+    };
+}
+
+Formation ScatterFormation(const vec2<>& min, const vec2<>& max, uint64_t seed)
+{
+    return [=](int index, int) {
+        float u = CounterRandom(seed, index, 0) * (1.f / 2147483648.f);
+        float v = CounterRandom(seed, index, 1) * (1.f / 2147483648.f);
+        return vec2<>(min.x + u * (max.x - min.x), min.y + v * (max.y - min.y));
+    };
+}
+
+Formation NamedFormation(const string& name, alliances alliance, uint64_t seed)
+{
+    bool blue = alliance == BLUE;
+    if (name == "block") return BlockFormation(blue ? vec2<>(24.f, 98.f) : vec2<>(980.f, 100.f));
+    if (name == "ring") return RingFormation(blue ? vec2<>(200.f, SCRHEIGHT / 2) : vec2<>(SCRWIDTH - 200.f, SCRHEIGHT / 2));
+    if (name == "wedge")
+        return blue ? WedgeFormation(vec2<>(400.f, SCRHEIGHT / 2), vec2<>(1.f, 0.f))
+                    : WedgeFormation(vec2<>(SCRWIDTH - 400.f, SCRHEIGHT / 2), vec2<>(-1.f, 0.f));
+    if (name == "scatter")
+        return blue ? ScatterFormation(vec2<>(0.f, 0.f), vec2<>(SCRWIDTH / 3, SCRHEIGHT), seed)
+                    : ScatterFormation(vec2<>(SCRWIDTH * 2 / 3, 0.f), vec2<>(SCRWIDTH, SCRHEIGHT), seed + 1);
+    return {};
+}
+} // namespace PP2
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "template.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace PP2
+{
+/**
+ * Gives the spawn position of tank index out of count tanks of an army
+ * Called from many threads at once, so it has to be a pure function of its arguments
+ */
+using Formation = std::function<vec2<>(int index, int count)>;
+
+/**
+ * Rows of max_rows tanks growing down from start, the layout Game::Init has always used
+ */
+Formation BlockFormation(const vec2<>& start, int max_rows = 12, float spacing = 15.f);
+
+/**
+ * Rings of 6, 12, 18, ... tanks around one in the center, every ring spacing further out
+ */
+Formation RingFormation(const vec2<>& center, float spacing = 15.f);
+
+/**
+ * A wedge with one tank at the tip and every row behind it one tank wider
+ * @param direction Where the tip points, normalized
+ */
+Formation WedgeFormation(const vec2<>& tip, const vec2<>& direction, float spacing = 15.f);
+
+/**
+ * Spread uniformly over a rectangle, the same seed gives the same positions on any thread count
+ */
+Formation ScatterFormation(const vec2<>& min, const vec2<>& max, uint64_t seed);
+
+/**
+ * A formation by name for the command line: block, ring, wedge or scatter, on the half of the field of the alliance
+ * @return An empty formation for an unknown name
+ */
+Formation NamedFormation(const std::string& name, alliances alliance, uint64_t seed = 0);
+} // namespace PP2
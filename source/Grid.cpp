@@ -1,26 +1,37 @@
 #include "Grid.h"
 #include "defines.h"
+#include <algorithm>
 #include <iostream>
 #include <mutex>
+#include <tbb/parallel_for.h>
 
 using namespace std;
 using namespace PP2;
 
-Grid* Grid::instance = nullptr;
-mutex mtx2;
-
-Grid::Grid()
+Grid::Grid(size_t cell_capacity)
 {
     for (auto& x : grid)
-        for (auto& y : x) y.reserve(500);
+        for (auto& y : x) y.reserve(cell_capacity);
 }
 
 Grid::~Grid() = default;
 
-Grid* Grid::Instance()
+void Grid::PlaceCells()
 {
-    if (instance == nullptr) instance = new Grid();
-    return instance;
+    tbb::parallel_for(
+        tbb::blocked_range<int>(0, GRID_SIZE + 1),
+        [&](tbb::blocked_range<int> r) {
+            for (int x = r.begin(); x < r.end(); ++x)
+                for (auto& cell : grid[x])
+                {
+                    std::vector<Tank*> placed;
+                    placed.reserve(cell.capacity());
+                    //Write the buffer here, otherwise its pages go to whichever thread first moves a tank into the cell
+                    std::fill_n(placed.data(), placed.capacity(), nullptr);
+                    cell.swap(placed);
+                }
+        },
+        tbb::static_partitioner());
 }
 
 // 0.05f => 100 / 2000 (assuming tanks wont go outside [x](-200, 1800), [y](-200, 1800))
@@ -46,11 +57,140 @@ vector<vec2<int>> Grid::GetNeighbouringCells()
     return cells;
 }
 
+size_t Grid::NeighbourCount(const vec2<int>& cell) const
+{
+    size_t count = 0;
+    for (int x = std::max(cell.x - 1, 0); x <= std::min(cell.x + 1, GRID_SIZE); ++x)
+        for (int y = std::max(cell.y - 1, 0); y <= std::min(cell.y + 1, GRID_SIZE); ++y) count += grid[x][y].size();
+    return count;
+}
+
+size_t Grid::RocketNeighbourCount(const vec2<int>& cell) const
+{
+    size_t count = 0;
+    for (int x = std::max(cell.x - 1, 0); x <= std::min(cell.x + 1, GRID_SIZE); ++x)
+        for (int y = std::max(cell.y - 1, 0); y <= std::min(cell.y + 1, GRID_SIZE); ++y) count += rocket_grid[x][y].size();
+    return count;
+}
+
 void Grid::AddTankToGridCell(Tank* tank) { grid[tank->gridCell.x][tank->gridCell.y].emplace_back(tank); }
 
+static int CellIndex(const vec2<int>& cell) { return cell.x * (GRID_SIZE + 1) + cell.y; }
+
+//Append count items to the cells in parallel with a counting sort in blocks of items, the items of a cell end up in
+//index order behind the ones already in it. cellOf(i) is the CellIndex of item i or -1 to leave it out
+template <class T, class CellOf, class Item>
+static void AppendToCells(vector<T> (&grid)[GRID_SIZE + 1][GRID_SIZE + 1], size_t count, CellOf cellOf, Item item)
+{
+    const int cells = (GRID_SIZE + 1) * (GRID_SIZE + 1);
+    const size_t block_size = 16384;
+    const size_t blocks = (count + block_size - 1) / block_size;
+
+    //Count the items of every block per cell
+    vector<uint32_t> offsets(blocks * cells, 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, blocks, 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t b = r.begin(); b < r.end(); ++b)
+            for (size_t i = b * block_size; i < min(count, (b + 1) * block_size); ++i)
+            {
+                int c = cellOf(i);
+                if (c >= 0) ++offsets[b * cells + c];
+            }
+    });
+
+    //Turn the counts into the position every block starts writing at, behind the items already in the cell
+    tbb::parallel_for(tbb::blocked_range<int>(0, cells), [&](tbb::blocked_range<int> r) {
+        for (int c = r.begin(); c < r.end(); ++c)
+        {
+            auto& cell = grid[c / (GRID_SIZE + 1)][c % (GRID_SIZE + 1)];
+            uint32_t position = (uint32_t)cell.size();
+            for (size_t b = 0; b < blocks; ++b)
+            {
+                uint32_t items = offsets[b * cells + c];
+                offsets[b * cells + c] = position;
+                position += items;
+            }
+            cell.resize(position);
+        }
+    });
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, blocks, 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t b = r.begin(); b < r.end(); ++b)
+            for (size_t i = b * block_size; i < min(count, (b + 1) * block_size); ++i)
+            {
+                int c = cellOf(i);
+                if (c >= 0) grid[c / (GRID_SIZE + 1)][c % (GRID_SIZE + 1)][offsets[b * cells + c]++] = item(i);
+            }
+    });
+}
+
+void Grid::AddTanks(std::vector<Tank>& tanks)
+{
+    AppendToCells(grid, tanks.size(), [&](size_t i) { return CellIndex(tanks[i].gridCell); }, [&](size_t i) { return &tanks[i]; });
+}
+
+void Grid::BinRockets(const std::vector<Rocket>& rockets)
+{
+    for (auto& x : rocket_grid)
+        for (auto& y : x) y.clear();
+
+    rocket_cells.resize(rockets.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, rockets.size()), [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); ++i)
+            rocket_cells[i] = rockets[i].active ? CellIndex(GetGridCell(rockets[i].position)) : -1;
+    });
+
+    AppendToCells(rocket_grid, rockets.size(), [&](size_t i) { return rocket_cells[i]; }, [](size_t i) { return (uint32_t)i; });
+}
+
+void Grid::Clear()
+{
+    for (auto& x : grid)
+        for (auto& y : x) y.clear();
+}
+
+void Grid::SortCells()
+{
+    auto byId = [](const Tank* a, const Tank* b) { return a->id < b->id; };
+    for (auto& x : grid)
+        for (auto& y : x)
+            if (!is_sorted(y.begin(), y.end(), byId)) sort(y.begin(), y.end(), byId);
+}
+
+void Grid::RemoveInactiveTanks()
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, GRID_SIZE + 1), [&](tbb::blocked_range<int> r) {
+        for (int x = r.begin(); x < r.end(); ++x) RemoveInactiveTanks(x);
+    });
+}
+
+void Grid::RemoveInactiveTanks(int x)
+{
+    for (auto& cell : grid[x]) cell.erase(remove_if(cell.begin(), cell.end(), [](const Tank* tank) { return !tank->active; }), cell.end());
+}
+
+uint32_t Grid::MortonCode(const vec2<int>& cell)
+{
+    uint32_t code = 0;
+    for (int bit = 0; bit < 16; ++bit)
+        code |= (((uint32_t)cell.x >> bit & 1) << (2 * bit)) | (((uint32_t)cell.y >> bit & 1) << (2 * bit + 1));
+    return code;
+}
+
+const vector<vec2<int>>& Grid::CellsInMortonOrder()
+{
+    static const vector<vec2<int>> cells = [] {
+        vector<vec2<int>> cells;
+        for (int x = 0; x < GRID_SIZE + 1; ++x)
+            for (int y = 0; y < GRID_SIZE + 1; ++y) cells.emplace_back(x, y);
+        sort(cells.begin(), cells.end(), [](const vec2<int>& a, const vec2<int>& b) { return MortonCode(a) < MortonCode(b); });
+        return cells;
+    }();
+    return cells;
+}
+
 void Grid::MoveTankToGridCell(PP2::Tank* tank, const vec2<int>& newPos)
 {
-    scoped_lock lock(mtx2);
+    scoped_lock lock(move_mutex);
     auto& gridCell = grid[tank->gridCell.x][tank->gridCell.y];
     grid[newPos.x][newPos.y].emplace_back(tank);
     for (int i = 0; i < gridCell.size(); ++i)
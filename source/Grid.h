@@ -1,28 +1,94 @@
 #pragma once
 
 #include "defines.h"
+#include "rocket.h"
 #include "tank.h"
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
 namespace PP2
 {
+/**
+ * The tanks of one game by grid cell, every Game owns its own so several battles can run in one process
+ */
 class Grid
 {
   public:
-    static Grid* Instance();
+    /**
+     * @param cell_capacity Tanks every cell has room for up front, so moving tanks between cells rarely reallocates
+     */
+    explicit Grid(size_t cell_capacity = 500);
+
+    //Width and height of a cell in pixels
+    static constexpr float cell_size = 100.f / (0.05f * GRID_SIZE);
+
     ~Grid();
     void AddTankToGridCell(Tank* tank);
+
+    /**
+     * Add every tank to its cell in parallel, the cells list their tanks in the same order as adding them one by one
+     */
+    void AddTanks(std::vector<Tank>& tanks);
+
+    /**
+     * Put the index of every active rocket in rocket_grid, the cell of a rocket is computed once here
+     * The indices of a cell are in index order
+     */
+    void BinRockets(const std::vector<Rocket>& rockets);
+    void Clear();
+
+    /**
+     * Order the tanks in every cell by their id
+     * The order tanks move into a cell depends on the scheduler, sorting makes it the same for any thread count
+     */
+    void SortCells();
+
+    /**
+     * Take the destroyed tanks out of their cells, the tanks left keep their order
+     */
+    void RemoveInactiveTanks();
+
+    /**
+     * Take the destroyed tanks out of the cells of one column
+     */
+    void RemoveInactiveTanks(int x);
     static vec2<int> GetGridCell(const vec2<>& position);
+
+    /**
+     * Interleave the bits of the cell coordinates, cells with close codes are close on the field
+     */
+    static uint32_t MortonCode(const vec2<int>& cell);
+
+    /**
+     * Every cell of the grid, ordered by MortonCode
+     */
+    static const std::vector<vec2<int>>& CellsInMortonOrder();
+
+    /**
+     * Number of tanks in a cell and the eight cells around it
+     */
+    size_t NeighbourCount(const vec2<int>& cell) const;
+
+    /**
+     * Number of rockets in a cell and the eight cells around it as of the last BinRockets
+     */
+    size_t RocketNeighbourCount(const vec2<int>& cell) const;
+    /**
+     * Give every column of cells a new buffer allocated and first touched by the thread that a static schedule runs
+     * that column on, call while the grid is empty
+     */
+    void PlaceCells();
     void MoveTankToGridCell(Tank* tank, const vec2<int>& newPos);
     static std::vector<vec2<int>> GetNeighbouringCells();
 
     std::vector<Tank*> grid[GRID_SIZE + 1][GRID_SIZE + 1];
 
-  private:
-    /* Here will be the instance stored. */
-    static Grid* instance;
+    //The rockets by cell as of the last BinRockets
+    std::vector<uint32_t> rocket_grid[GRID_SIZE + 1][GRID_SIZE + 1];
 
-    /* Private constructor to prevent instancing. */
-    Grid();
+  private:
+    std::mutex move_mutex;
+    std::vector<int> rocket_cells;
 };
 } // namespace PP2
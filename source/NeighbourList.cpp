@@ -0,0 +1,260 @@
+#include "NeighbourList.h"
+#include "Algorithms.h"
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+using namespace std;
+
+namespace PP2
+{
+//Push both tanks of a pair apart when they overlap, force collects the pushes of tank to apply them once. A tank
+//destroyed since the lists were built stays in them but is passed through like a wreck
+static void SeparatePair(Tank& tank, float radius, vec2<>& force, Tank& oTank)
+{
+    if (!tank.active || !oTank.active) return;
+
+    vec2<> dir = tank.Get_Position() - oTank.Get_Position();
+    float colSquaredLen = radius + (oTank.Get_collision_radius() * oTank.Get_collision_radius());
+    if (dir.sqrLength() >= colSquaredLen) return;
+
+    vec2<> direction = dir.normalized();
+    force += direction;
+    oTank.Push(-direction, 1.f);
+}
+
+bool NeighbourList::Separate(vector<Tank>& tanks, Grid& grid)
+{
+    if (sweeps > 0)
+    {
+        --sweeps;
+        SeparateTanks(grid);
+        return false;
+    }
+
+    bool build = !built || built_positions.size() != tanks.size() || Moved(tanks);
+
+    //Lists that were used on a single frame only cost time, a sweep pushes the same pairs as building them does
+    if (build && built && age <= 1)
+    {
+        built = false;
+        sweeps = sweep_frames - 1;
+        SeparateTanks(grid);
+        return false;
+    }
+
+    ++age;
+    columns.resize(GRID_SIZE + 1);
+
+    //A tank is only in the lists of the column it was in when they were built and of the column before it, however far
+    //it moved since, so the columns of one parity never touch the same tank
+    for (int parity = 0; parity < 2; ++parity)
+        tbb::parallel_for(
+            tbb::blocked_range<int>(0, (GRID_SIZE + 2 - parity) / 2, 1),
+            [&](tbb::blocked_range<int> r) {
+                for (int i = r.begin(); i < r.end(); ++i)
+                {
+                    if (build)
+                        BuildColumn(parity + 2 * i, tanks, grid);
+                    else
+                        SeparateColumn(parity + 2 * i, tanks);
+                }
+            },
+            tbb::simple_partitioner());
+
+    if (!build) return false;
+
+    built_positions.resize(tanks.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, tanks.size()), [&](tbb::blocked_range<size_t> r) {
+        for (size_t i = r.begin(); i < r.end(); ++i) built_positions[i] = tanks[i].position;
+    });
+    built = true;
+    age = 1;
+    return true;
+}
+
+bool NeighbourList::Moved(const vector<Tank>& tanks) const
+{
+    float limit = skin * 0.5f * skin * 0.5f;
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, tanks.size()), false,
+        [&](tbb::blocked_range<size_t> r, bool moved) {
+            for (size_t i = r.begin(); i < r.end() && !moved; ++i) moved = (tanks[i].position - built_positions[i]).sqrLength() > limit;
+            return moved;
+        },
+        [](bool a, bool b) { return a || b; });
+}
+
+void NeighbourList::BuildColumn(int x, vector<Tank>& tanks, const Grid& grid)
+{
+    static const vec2<int> forward[] = {{0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+    Column& column = columns[x];
+    column.tanks.clear();
+    column.ends.clear();
+    column.others.clear();
+
+    Tank* base = tanks.data();
+    for (int y = 0; y <= GRID_SIZE; ++y)
+    {
+        const auto& cell = grid.grid[x][y];
+        for (size_t i = 0; i < cell.size(); ++i)
+        {
+            Tank& tank = *cell[i];
+            if (!tank.active) continue;
+
+            float radius = tank.Get_collision_radius() * tank.Get_collision_radius();
+            size_t begin = column.others.size();
+            vec2<> force(0.f, 0.f);
+
+            //The sum of the radii is never below the collision distance, so this keeps every pair that can collide
+            //before the lists are built again without taking a square root per pair. Wrecks never collide
+            auto add = [&](Tank* oTank) {
+                if (!oTank->active) return;
+                float reach = tank.Get_collision_radius() + oTank->Get_collision_radius() + skin;
+                if ((tank.Get_Position() - oTank->Get_Position()).sqrLength() >= reach * reach) return;
+
+                column.others.push_back((uint32_t)(oTank - base));
+                SeparatePair(tank, radius, force, *oTank);
+            };
+
+            for (size_t j = i + 1; j < cell.size(); ++j) add(cell[j]);
+            for (const vec2<int>& offset : forward)
+            {
+                int oX = x + offset.x;
+                int oY = y + offset.y;
+                if (oY < 0 || oX > GRID_SIZE || oY > GRID_SIZE) continue;
+
+                for (Tank* oTank : grid.grid[oX][oY]) add(oTank);
+            }
+
+            tank.Push(force, 1.f);
+
+            if (column.others.size() == begin) continue;
+            column.tanks.push_back((uint32_t)(&tank - base));
+            column.ends.push_back((uint32_t)column.others.size());
+        }
+    }
+}
+
+void NeighbourList::SeparateColumn(int x, vector<Tank>& tanks) const
+{
+    const Column& column = columns[x];
+    uint32_t begin = 0;
+    for (size_t t = 0; t < column.tanks.size(); ++t)
+    {
+        Tank& tank = tanks[column.tanks[t]];
+        float radius = tank.Get_collision_radius() * tank.Get_collision_radius();
+
+        vec2<> force(0.f, 0.f);
+        for (uint32_t o = begin; o < column.ends[t]; ++o) SeparatePair(tank, radius, force, tanks[column.others[o]]);
+        begin = column.ends[t];
+
+        if (tank.active) tank.Push(force, 1.f);
+    }
+}
+void NeighbourList::Remap(const vector<uint32_t>& slots)
+{
+    if (!built) return;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, columns.size(), 1), [&](tbb::blocked_range<size_t> r) {
+        for (size_t x = r.begin(); x < r.end(); ++x)
+        {
+            for (uint32_t& tank : columns[x].tanks) tank = slots[tank];
+            for (uint32_t& tank : columns[x].others) tank = slots[tank];
+        }
+    });
+
+    vector<vec2<>> positions(built_positions.size());
+    for (size_t i = 0; i < built_positions.size(); ++i) positions[slots[i]] = built_positions[i];
+    built_positions.swap(positions);
+}
+
+void NeighbourList::Save(CheckpointWriter& out) const
+{
+    out.Write(skin);
+    out.Write((int32_t)sweeps);
+    out.Write((uint8_t)built);
+    if (!built) return;
+
+    out.Write((int32_t)age);
+    out.Write((uint32_t)built_positions.size());
+    for (const vec2<>& position : built_positions) out.Write(position);
+    for (const Column& column : columns)
+    {
+        out.Write((uint32_t)column.tanks.size());
+        for (size_t t = 0; t < column.tanks.size(); ++t)
+        {
+            out.Write(column.tanks[t]);
+            out.Write(column.ends[t]);
+        }
+        out.Write((uint32_t)column.others.size());
+        for (uint32_t other : column.others) out.Write(other);
+    }
+}
+
+bool NeighbourList::Load(CheckpointReader& in, size_t tank_count)
+{
+    auto saved_skin = in.Read<float>();
+    auto saved_sweeps = in.Read<int32_t>();
+    bool saved_built = in.Read<uint8_t>() != 0;
+    if (!saved_built)
+    {
+        built = false;
+        sweeps = saved_skin == skin ? saved_sweeps : 0;
+        return in.Ok() && saved_sweeps >= 0 && saved_sweeps < sweep_frames;
+    }
+
+    auto saved_age = in.Read<int32_t>();
+    auto position_count = in.Read<uint32_t>();
+    if (!in.Fits(position_count, 2 * sizeof(float))) return false;
+    vector<vec2<>> positions(position_count);
+    for (vec2<>& position : positions) in.Read(position);
+
+    bool valid = positions.size() == tank_count && saved_sweeps == 0 && saved_age > 0;
+    vector<Column> saved(GRID_SIZE + 1);
+    for (Column& column : saved)
+    {
+        //A tank and its end per entry, no count is used before the bytes left can hold it
+        auto tank_entries = in.Read<uint32_t>();
+        if (!in.Fits(tank_entries, 2 * sizeof(uint32_t))) return false;
+        column.tanks.resize(tank_entries);
+        column.ends.resize(tank_entries);
+        for (size_t t = 0; t < column.tanks.size() && in.Ok(); ++t)
+        {
+            in.Read(column.tanks[t]);
+            in.Read(column.ends[t]);
+        }
+        auto other_entries = in.Read<uint32_t>();
+        if (!in.Fits(other_entries, sizeof(uint32_t))) return false;
+        column.others.resize(other_entries);
+        for (uint32_t& other : column.others) in.Read(other);
+
+        for (size_t t = 0; t < column.tanks.size(); ++t)
+            valid = valid && column.tanks[t] < tank_count && column.ends[t] <= column.others.size() && (t == 0 || column.ends[t] >= column.ends[t - 1]);
+        for (uint32_t other : column.others) valid = valid && other < tank_count;
+        if (!in.Ok()) return false;
+    }
+
+    //Lists with another skin would be built again on other frames, so start over instead
+    if (!valid || saved_skin != skin)
+    {
+        built = false;
+        sweeps = 0;
+        return valid;
+    }
+
+    sweeps = 0;
+    age = saved_age;
+    columns = move(saved);
+    built_positions = move(positions);
+    built = true;
+    return true;
+}
+
+size_t NeighbourList::Pairs() const
+{
+    size_t pairs = 0;
+    for (const Column& column : columns) pairs += column.others.size();
+    return pairs;
+}
+} // namespace PP2
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Checkpoint.h"
+#include "Grid.h"
+#include "tank.h"
+#include <cstdint>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Verlet lists for separating tanks: every pair of tanks closer than their collision distance plus a skin, found with
+ * the column sweep of SeparateTanks and kept until a tank has moved more than half the skin. Until then no pair that
+ * is missing from the lists can get close enough to collide, so separating from the lists pushes the same pairs as
+ * sweeping the cells does, only from a few compact index lists instead of the grid. The lists are built during the
+ * sweep that separates the tanks on that frame, so a frame that builds them costs little more than SeparateTanks.
+ * In crowds that push some tank past half the skin every frame the lists never pay off, so when lists last a single
+ * frame the next sweep_frames frames just call SeparateTanks before building them again
+ */
+class NeighbourList
+{
+  public:
+    /**
+     * @param skin Extra distance in pixels, the collision distance plus the skin has to fit in a grid cell
+     */
+    explicit NeighbourList(float skin) : skin(skin) {}
+
+    /**
+     * Push every active tank away from the tanks it overlaps like SeparateTanks, in the same two passes over the
+     * columns so the forces add up in the same order for any thread count. The lists are built again when a tank
+     * moved more than half the skin since they were last built or after Invalidate
+     * @return True when the lists were built again
+     */
+    bool Separate(std::vector<Tank>& tanks, Grid& grid);
+
+    /**
+     * Build the lists on the next Separate that does not sweep
+     */
+    void Invalidate() { built = false; }
+
+    /**
+     * Follow the tanks to their new place in memory, slots holds the new index of every old index
+     * The lists keep their order, so separating gives the same forces as before the move
+     */
+    void Remap(const std::vector<uint32_t>& slots);
+
+    /**
+     * Write the lists and where the tanks were when they were built, a restored game builds them again on the same frame
+     */
+    void Save(CheckpointWriter& out) const;
+
+    /**
+     * Read lists written by Save, left unchanged when the file does not hold valid lists for tank_count tanks
+     */
+    bool Load(CheckpointReader& in, size_t tank_count);
+
+    size_t Pairs() const;
+
+    float Skin() const { return skin; }
+
+    static constexpr int sweep_frames = 8;
+
+  private:
+    //The pairs found by the sweep of one column of cells, every tank in tanks is paired with the others up to its end
+    struct Column
+    {
+        std::vector<uint32_t> tanks;
+        std::vector<uint32_t> ends;
+        std::vector<uint32_t> others;
+    };
+
+    bool Moved(const std::vector<Tank>& tanks) const;
+
+    void BuildColumn(int x, std::vector<Tank>& tanks, const Grid& grid);
+
+    void SeparateColumn(int x, std::vector<Tank>& tanks) const;
+
+    float skin;
+    bool built = false;
+    //Frames the lists were used on since they were built, and frames left to sweep without lists
+    int age = 0;
+    int sweeps = 0;
+    std::vector<Column> columns;
+    std::vector<vec2<>> built_positions;
+};
+} // namespace PP2
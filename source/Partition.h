@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Splits [0, count) into ranges of about equal cost instead of equal length, so a loop whose items are
+ * much more expensive in a few places (tanks in a crowded cell) still keeps every worker busy
+ */
+class CostPartition
+{
+  public:
+    /**
+     * @param parts Number of ranges, a few per thread leaves room for stealing
+     * @param cost Estimated cost of item i, at least 1
+     */
+    template <class Cost>
+    void Build(size_t count, size_t parts, Cost cost)
+    {
+        prefix.resize(count + 1);
+        prefix[0] = 0;
+        for (size_t i = 0; i < count; ++i) prefix[i + 1] = prefix[i] + cost(i);
+
+        parts = std::max<size_t>(1, std::min(parts, count));
+        bounds.resize(parts + 1);
+        bounds[0] = 0;
+        for (size_t p = 1; p < parts; ++p)
+        {
+            uint64_t target = prefix[count] * p / parts;
+            bounds[p] = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+        }
+        bounds[parts] = count;
+    }
+
+    size_t Parts() const { return bounds.empty() ? 0 : bounds.size() - 1; }
+
+    size_t Begin(size_t part) const { return bounds[part]; }
+
+    size_t End(size_t part) const { return bounds[part + 1]; }
+
+    /**
+     * Hand the ranges to the threads in the same order every time instead of letting them be stolen,
+     * so with pinned threads every range keeps running next to the memory it touched first
+     */
+    void SetStatic(bool enabled) { is_static = enabled; }
+
+    bool IsStatic() const { return is_static; }
+
+  private:
+    std::vector<uint64_t> prefix;
+    std::vector<size_t> bounds;
+    bool is_static = false;
+};
+
+/**
+ * Run body over every range of the partition, one task per range
+ */
+template <class F>
+void ParallelFor(const CostPartition& partition, F body)
+{
+    auto run = [&](const tbb::blocked_range<size_t>& parts) {
+        for (size_t p = parts.begin(); p != parts.end(); ++p)
+            body(tbb::blocked_range<int>((int)partition.Begin(p), (int)partition.End(p)));
+    };
+
+    if (partition.IsStatic())
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, partition.Parts(), 1), run, tbb::static_partitioner());
+    else
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, partition.Parts(), 1), run, tbb::simple_partitioner());
+}
+} // namespace PP2
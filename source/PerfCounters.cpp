@@ -0,0 +1,174 @@
+#include "PerfCounters.h"
+#include <cstdio>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PP2
+{
+PerfCounters* PerfCounters::Instance()
+{
+    static PerfCounters counters;
+    return &counters;
+}
+
+#ifdef __linux__
+/**
+ * The counter group of one thread, opened the first time the thread enters a phase
+ */
+struct ThreadCounters
+{
+    int fds[PerfCounters::COUNTER_COUNT] = {-1, -1, -1, -1};
+    bool opened = false;
+    bool ok = false;
+    bool active[PHASE_COUNT] = {};
+
+    // Returns the error of the counter that could not be opened, 0 on success
+    int Open()
+    {
+        opened = true;
+
+        const uint64_t configs[PerfCounters::COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES};
+
+        for (int i = 0; i < PerfCounters::COUNTER_COUNT; ++i)
+        {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            // Count this thread on any cpu, the first counter leads the group so all are scheduled together
+            fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] == -1)
+            {
+                int error = errno;
+                Close();
+                return error;
+            }
+        }
+
+        ok = true;
+        return 0;
+    }
+
+    bool Read(uint64_t* values) const
+    {
+        struct
+        {
+            uint64_t nr;
+            uint64_t values[PerfCounters::COUNTER_COUNT];
+        } group;
+
+        if (read(fds[0], &group, sizeof(group)) != sizeof(group)) return false;
+        for (int i = 0; i < PerfCounters::COUNTER_COUNT; ++i) values[i] = group.values[i];
+        return true;
+    }
+
+    void Close()
+    {
+        for (int& fd : fds)
+        {
+            if (fd != -1) close(fd);
+            fd = -1;
+        }
+        ok = false;
+    }
+
+    ~ThreadCounters() { Close(); }
+};
+
+static thread_local ThreadCounters thread_counters;
+
+bool PerfCounters::Enable()
+{
+    if (!thread_counters.opened)
+    {
+        int error = thread_counters.Open();
+        if (error != 0)
+        {
+            cout << "Performance counters unavailable: perf_event_open failed with \"" << strerror(error) << "\"";
+            if (error == EACCES || error == EPERM) cout << " (see /proc/sys/kernel/perf_event_paranoid)";
+            cout << endl;
+        }
+    }
+
+    enabled.store(thread_counters.ok, memory_order_relaxed);
+    return thread_counters.ok;
+}
+
+bool PerfCounters::Begin(Phase phase, uint64_t* start)
+{
+    if (!thread_counters.opened) thread_counters.Open();
+    if (!thread_counters.ok || thread_counters.active[phase]) return false;
+
+    if (!thread_counters.Read(start)) return false;
+    thread_counters.active[phase] = true;
+    return true;
+}
+
+void PerfCounters::End(Phase phase, const uint64_t* start)
+{
+    thread_counters.active[phase] = false;
+
+    uint64_t end[COUNTER_COUNT];
+    if (!thread_counters.Read(end)) return;
+
+    for (int i = 0; i < COUNTER_COUNT; ++i) totals[phase][i].fetch_add(end[i] - start[i], memory_order_relaxed);
+}
+#else
+bool PerfCounters::Enable()
+{
+    cout << "Performance counters unavailable: perf_event_open is only supported on Linux" << endl;
+    return false;
+}
+
+bool PerfCounters::Begin(Phase phase, uint64_t* start) { return false; }
+
+void PerfCounters::End(Phase phase, const uint64_t* start) {}
+#endif
+
+void PerfCounters::Print(ostream& out) const
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%-20s %14s %14s %6s %12s %12s %8s %8s\n", "phase", "cycles", "instructions", "IPC",
+             "cache-miss", "branch-miss", "c-MPKI", "b-MPKI");
+    out << line;
+
+    for (int p = 0; p < PHASE_COUNT; ++p)
+    {
+        uint64_t values[COUNTER_COUNT];
+        for (int i = 0; i < COUNTER_COUNT; ++i) values[i] = totals[p][i].load(memory_order_relaxed);
+        if (values[CYCLES] == 0) continue;
+
+        double kilo_instructions = values[INSTRUCTIONS] / 1000.0;
+        snprintf(line, sizeof(line), "%-20s %14llu %14llu %6.2f %12llu %12llu %8.2f %8.2f\n", PhaseNames[p],
+                 (unsigned long long)values[CYCLES], (unsigned long long)values[INSTRUCTIONS],
+                 (double)values[INSTRUCTIONS] / values[CYCLES], (unsigned long long)values[CACHE_MISSES],
+                 (unsigned long long)values[BRANCH_MISSES], values[CACHE_MISSES] / kilo_instructions,
+                 values[BRANCH_MISSES] / kilo_instructions);
+        out << line;
+    }
+}
+
+void PerfCounters::Reset()
+{
+    for (auto& phase : totals)
+        for (auto& counter : phase) counter.store(0, memory_order_relaxed);
+}
+} // namespace PP2
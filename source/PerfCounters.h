@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Phase.h"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace PP2
+{
+/**
+ * Hardware performance counters (cycles, instructions, cache misses, branch misses) per phase
+ * Every thread opens its own counters through perf_event_open the first time it enters a phase,
+ * when the kernel refuses access or the platform is not Linux the counters stay disabled
+ */
+class PerfCounters
+{
+  public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        COUNTER_COUNT
+    };
+
+    static PerfCounters* Instance();
+
+    /**
+     * Try to open the counters on the calling thread
+     * @return False with a message on stdout when the counters are not available
+     */
+    bool Enable();
+
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Start counting a phase on the calling thread
+     * @param start Receives the current counter values
+     * @return False when this thread has no counters or is already counting the phase
+     */
+    bool Begin(Phase phase, uint64_t* start);
+
+    /**
+     * Add everything counted on the calling thread since Begin to the phase
+     */
+    void End(Phase phase, const uint64_t* start);
+
+    /**
+     * Print the counters, IPC and misses per thousand instructions of every phase that was counted
+     */
+    void Print(std::ostream& out) const;
+
+    void Reset();
+
+  private:
+    PerfCounters() { Reset(); }
+
+    static inline std::atomic<bool> enabled{false};
+
+    std::atomic<uint64_t> totals[PHASE_COUNT][COUNTER_COUNT];
+};
+
+/**
+ * Adds the counter values over the lifetime of this object to a phase
+ * Nested scopes of the same phase on one thread are only counted once, so a parallel loop can
+ * count its chunks on the workers while the calling thread counts the whole phase
+ */
+class CounterScope
+{
+  public:
+    explicit CounterScope(Phase phase)
+        : phase(phase), counting(PerfCounters::Enabled() && PerfCounters::Instance()->Begin(phase, start)) {}
+
+    ~CounterScope()
+    {
+        if (counting) PerfCounters::Instance()->End(phase, start);
+    }
+
+  private:
+    Phase phase;
+    uint64_t start[PerfCounters::COUNTER_COUNT];
+    bool counting;
+};
+} // namespace PP2
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace PP2
+{
+/**
+ * The timed parts of a frame
+ */
+enum Phase
+{
+    PHASE_UPDATE,
+    PHASE_BUILD_KD_TREE,
+    PHASE_UPDATE_PARTICLE_BEAMS,
+    PHASE_UPDATE_SMOKE,
+    PHASE_UPDATE_EXPLOSIONS,
+    PHASE_UPDATE_ROCKETS,
+    PHASE_UPDATE_TANKS,
+    PHASE_UPDATE_RED_HP,
+    PHASE_UPDATE_BLUE_HP,
+    PHASE_SORT_TANKS,
+    PHASE_COMPACT_TANKS,
+    PHASE_DRAW,
+    PHASE_RENDER_PRESENT,
+    PHASE_COUNT
+};
+
+const char* const PhaseNames[PHASE_COUNT] = {
+    "Update",
+    "BuildKDTree",
+    "UpdateParticleBeams",
+    "UpdateSmoke",
+    "UpdateExplosions",
+    "UpdateRockets",
+    "UpdateTanks",
+    "UpdateRedHP",
+    "UpdateBlueHP",
+    "SortTanks",
+    "CompactTanks",
+    "Draw",
+    "SDL_RenderPresent"};
+} // namespace PP2
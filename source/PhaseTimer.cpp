@@ -0,0 +1,80 @@
+#include "PhaseTimer.h"
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace PP2
+{
+int PhaseTimer::BucketIndex(uint64_t ns)
+{
+    if (ns < SUB_BUCKETS) return (int)ns;
+
+#ifdef _MSC_VER
+    unsigned long msb;
+    _BitScanReverse64(&msb, ns);
+#else
+    int msb = 63 - __builtin_clzll(ns);
+#endif
+    // The 3 bits below the most significant bit select the sub bucket
+    int sub = (int)(ns >> (msb - 3)) - SUB_BUCKETS;
+    return (msb - 2) * SUB_BUCKETS + sub;
+}
+
+uint64_t PhaseTimer::BucketUpperBound(int index)
+{
+    if (index < SUB_BUCKETS) return index + 1;
+
+    int msb = index / SUB_BUCKETS + 2;
+    int sub = index % SUB_BUCKETS;
+    return (uint64_t)(SUB_BUCKETS + sub + 1) << (msb - 3);
+}
+
+float PhaseTimer::Percentile(Phase phase, float fraction) const
+{
+    const Histogram& h = histograms[phase];
+    uint64_t count = h.count.load(std::memory_order_relaxed);
+    if (count == 0) return 0.f;
+
+    uint64_t rank = (uint64_t)(fraction * count);
+    if (rank >= count) rank = count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += h.buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) return std::min(BucketUpperBound(i), h.max.load(std::memory_order_relaxed)) / 1e6f;
+    }
+    return Max(phase);
+}
+
+void PhaseTimer::Print(std::ostream& out) const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%-20s %8s %9s %9s %9s %9s %9s\n", "phase (ms)", "count", "avg", "p50", "p95", "p99", "max");
+    out << line;
+
+    for (int p = 0; p < PHASE_COUNT; ++p)
+    {
+        Phase phase = (Phase)p;
+        if (Count(phase) == 0) continue;
+
+        snprintf(line, sizeof(line), "%-20s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", PhaseNames[p],
+                 (unsigned long long)Count(phase), Total(phase) / Count(phase), Percentile(phase, 0.5f),
+                 Percentile(phase, 0.95f), Percentile(phase, 0.99f), Max(phase));
+        out << line;
+    }
+}
+
+void PhaseTimer::Reset()
+{
+    for (Histogram& h : histograms)
+    {
+        for (auto& bucket : h.buckets) bucket.store(0, std::memory_order_relaxed);
+        h.count.store(0, std::memory_order_relaxed);
+        h.total.store(0, std::memory_order_relaxed);
+        h.max.store(0, std::memory_order_relaxed);
+    }
+}
+} // namespace PP2
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Phase.h"
+#include "PerfCounters.h"
+#include "template.h"
+#include <atomic>
+#include <ostream>
+
+namespace PP2
+{
+/**
+ * Lock-free histogram of the time spent in every phase
+ * Buckets are log-linear, 8 per power of two of nanoseconds, so percentiles are at most 12.5% too high
+ */
+class PhaseTimer
+{
+  public:
+    PhaseTimer() { Reset(); }
+
+    /**
+     * Record one sample, safe to call from any thread
+     * @param phase The phase that was timed
+     * @param ns Duration in nanoseconds
+     */
+    void Add(Phase phase, uint64_t ns)
+    {
+        Histogram& h = histograms[phase];
+        h.buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        h.count.fetch_add(1, std::memory_order_relaxed);
+        h.total.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t max = h.max.load(std::memory_order_relaxed);
+        while (ns > max && !h.max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    /**
+     * @return Total time spent in the phase in milliseconds
+     */
+    float Total(Phase phase) const { return histograms[phase].total.load(std::memory_order_relaxed) / 1e6f; }
+
+    /**
+     * @return Number of times the phase was timed
+     */
+    uint64_t Count(Phase phase) const { return histograms[phase].count.load(std::memory_order_relaxed); }
+
+    /**
+     * @param fraction Percentile to look up, 0.99 for p99
+     * @return Upper estimate of the percentile in milliseconds
+     */
+    float Percentile(Phase phase, float fraction) const;
+
+    /**
+     * @return Slowest sample of the phase in milliseconds
+     */
+    float Max(Phase phase) const { return histograms[phase].max.load(std::memory_order_relaxed) / 1e6f; }
+
+    /**
+     * Print count, average, p50, p95, p99 and max of every phase that was timed
+     */
+    void Print(std::ostream& out) const;
+
+    void Reset();
+
+  private:
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKET_COUNT = 62 * SUB_BUCKETS;
+
+    static int BucketIndex(uint64_t ns);
+    static uint64_t BucketUpperBound(int index);
+
+    struct Histogram
+    {
+        std::atomic<uint32_t> buckets[BUCKET_COUNT];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> max;
+    };
+
+    Histogram histograms[PHASE_COUNT];
+};
+
+/**
+ * Adds the lifetime of this object to a phase, and the hardware counters when they are enabled
+ */
+class ScopedPhaseTimer
+{
+  public:
+    ScopedPhaseTimer(PhaseTimer& phase_timer, Phase phase)
+        : phase_timer(phase_timer), phase(phase), counters(phase), start(timer::get()) {}
+
+    ~ScopedPhaseTimer()
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timer::get() - start).count();
+        phase_timer.Add(phase, ns);
+    }
+
+  private:
+    PhaseTimer& phase_timer;
+    Phase phase;
+    CounterScope counters;
+    decltype(timer::get()) start;
+};
+} // namespace PP2
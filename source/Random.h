@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+namespace PP2
+{
+/**
+ * Counter based random number, the same seed, stream and counter always give the same number
+ * no matter which thread asks or in which order, so results do not depend on the scheduler
+ * @param stream The entity asking, for example a tank index
+ * @param counter Position in the stream, for example the frame
+ * @return A number in [0, 2^31)
+ */
+inline uint32_t CounterRandom(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+    //SplitMix64 finalizer over the combined key
+    uint64_t z = seed + stream * 0x9E3779B97F4A7C15ull + counter * 0xD1B54A32D192ED03ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)((z ^ (z >> 31)) >> 33);
+}
+} // namespace PP2
@@ -0,0 +1,514 @@
+#include "Replay.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PP2
+{
+static const char replay_magic[4] = {'P', 'P', '2', 'R'};
+static const uint32_t replay_version = 2; // 2 added compressed replays
+
+static size_t Pad4(size_t bytes) { return (bytes + 3) & ~size_t(3); }
+
+// Positions in delta frames are stored in 1/256 pixel
+static int32_t ToFixed(float v) { return (int32_t)lrintf(v * 256.f); }
+
+static float FromFixed(int32_t v) { return v * (1.f / 256.f); }
+
+// Store the values as a plane of low bytes followed by a plane of high bytes, which compresses far better
+static void AppendPlanes(vector<char>& out, const int16_t* values, size_t count)
+{
+    size_t offset = out.size();
+    out.resize(offset + Pad4(count * sizeof(int16_t)), 0);
+
+    char* low = out.data() + offset;
+    char* high = low + count;
+    for (size_t i = 0; i < count; ++i)
+    {
+        low[i] = (char)(values[i] & 0xFF);
+        high[i] = (char)((uint16_t)values[i] >> 8);
+    }
+}
+
+//Bytes of the tank columns of a full frame or of a delta frame
+static size_t TankColumnBytes(size_t count, bool delta)
+{
+    if (delta) return 3 * Pad4(count * sizeof(int16_t));
+    return 2 * Pad4(count * sizeof(float)) + Pad4(count * sizeof(int16_t));
+}
+
+//Bytes of the columns of the rockets, explosions and smokes spawned in a frame
+static size_t SpawnedColumnBytes(const ReplayFrameHeader& h)
+{
+    return 4 * Pad4((size_t)h.rocket_count * sizeof(float)) + Pad4(h.rocket_count) +
+           2 * Pad4((size_t)h.explosion_count * sizeof(float)) + 2 * Pad4((size_t)h.smoke_count * sizeof(float));
+}
+
+static int16_t ReadPlanes(const char* planes, size_t count, size_t i)
+{
+    return (int16_t)((uint8_t)planes[i] | ((uint8_t)planes[count + i] << 8));
+}
+
+// Append one column, padded to 4 bytes
+template <class T, class Container, class Getter>
+static void AppendColumn(vector<char>& out, const Container& items, size_t first, Getter get)
+{
+    size_t count = items.size() - first;
+    size_t offset = out.size();
+    out.resize(offset + Pad4(count * sizeof(T)), 0);
+
+    T* column = reinterpret_cast<T*>(out.data() + offset);
+    for (size_t i = 0; i < count; ++i) column[i] = get(items[first + i]);
+}
+
+//A column of the tanks in the given order
+template <class T, class Getter>
+static void AppendTankColumn(vector<char>& out, const vector<Tank>& tanks, const vector<uint32_t>& order, Getter get)
+{
+    size_t offset = out.size();
+    out.resize(offset + Pad4(order.size() * sizeof(T)), 0);
+
+    T* column = reinterpret_cast<T*>(out.data() + offset);
+    for (size_t i = 0; i < order.size(); ++i) column[i] = get(tanks[order[i]]);
+}
+
+ReplayRecorder::ReplayRecorder(const string& path, const vector<Tank>& tanks, const vector<uint32_t>& order, uint32_t keyframe_interval)
+    : keyframe_interval(keyframe_interval)
+{
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        cout << "Could not open replay file " << path << endl;
+        return;
+    }
+
+    ReplayHeader header = {};
+    memcpy(header.magic, replay_magic, sizeof(header.magic));
+    header.version = replay_version;
+    header.tank_count = (uint32_t)tanks.size();
+    header.keyframe_interval = keyframe_interval;
+
+    vector<char> buffer(sizeof(header));
+    memcpy(buffer.data(), &header, sizeof(header));
+    AppendTankColumn<uint8_t>(buffer, tanks, order, [](const Tank& t) { return (uint8_t)t.alliance; });
+    fwrite(buffer.data(), 1, buffer.size(), file);
+
+    last_x.resize(tanks.size());
+    last_y.resize(tanks.size());
+    last_health.resize(tanks.size());
+
+    writer = thread(&ReplayRecorder::WriterThread, this);
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+    if (file == nullptr) return;
+
+    {
+        scoped_lock lock(queue_mutex);
+        stop = true;
+    }
+    condition.notify_one();
+    writer.join();
+
+    fclose(file);
+}
+
+void ReplayRecorder::RecordFrame(long long frame, const vector<Tank>& tanks, const vector<uint32_t>& order,
+                                 const vector<Rocket>& rockets, size_t first_rocket,
+                                 const vector<Explosion>& explosions, size_t first_explosion,
+                                 const vector<Smoke>& smokes, size_t first_smoke)
+{
+    if (file == nullptr) return;
+
+    vector<char> buffer;
+    {
+        scoped_lock lock(queue_mutex);
+        if (!free_buffers.empty())
+        {
+            buffer = move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+    buffer.clear();
+
+    ReplayFrameHeader header = {};
+    header.frame = (uint32_t)frame;
+    header.rocket_count = (uint32_t)(rockets.size() - first_rocket);
+    header.explosion_count = (uint32_t)(explosions.size() - first_explosion);
+    header.smoke_count = (uint32_t)(smokes.size() - first_smoke);
+    buffer.resize(sizeof(header));
+
+    AppendTankColumn<float>(buffer, tanks, order, [](const Tank& t) { return t.position.x; });
+    AppendTankColumn<float>(buffer, tanks, order, [](const Tank& t) { return t.position.y; });
+    AppendTankColumn<int16_t>(buffer, tanks, order, [](const Tank& t) { return (int16_t)max(t.health, 0); });
+
+    AppendColumn<float>(buffer, rockets, first_rocket, [](const Rocket& r) { return r.position.x; });
+    AppendColumn<float>(buffer, rockets, first_rocket, [](const Rocket& r) { return r.position.y; });
+    AppendColumn<float>(buffer, rockets, first_rocket, [](const Rocket& r) { return r.speed.x; });
+    AppendColumn<float>(buffer, rockets, first_rocket, [](const Rocket& r) { return r.speed.y; });
+    AppendColumn<uint8_t>(buffer, rockets, first_rocket, [](const Rocket& r) { return (uint8_t)r.allignment; });
+
+    AppendColumn<float>(buffer, explosions, first_explosion, [](const Explosion& e) { return e.position.x; });
+    AppendColumn<float>(buffer, explosions, first_explosion, [](const Explosion& e) { return e.position.y; });
+
+    AppendColumn<float>(buffer, smokes, first_smoke, [](const Smoke& s) { return s.position.x; });
+    AppendColumn<float>(buffer, smokes, first_smoke, [](const Smoke& s) { return s.position.y; });
+
+    header.size = (uint32_t)buffer.size();
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    {
+        scoped_lock lock(queue_mutex);
+        queue.emplace_back(move(buffer));
+    }
+    condition.notify_one();
+}
+
+void ReplayRecorder::WriterThread()
+{
+    while (true)
+    {
+        vector<char> buffer;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            condition.wait(lock, [this] { return stop || !queue.empty(); });
+
+            // Drain the queue before stopping so no frame is lost
+            if (queue.empty()) break;
+
+            buffer = move(queue.front());
+            queue.pop_front();
+        }
+
+        if (keyframe_interval == 0)
+            fwrite(buffer.data(), 1, buffer.size(), file);
+        else
+            WriteCompressed(buffer);
+
+        scoped_lock lock(queue_mutex);
+        free_buffers.emplace_back(move(buffer));
+    }
+}
+
+void ReplayRecorder::WriteCompressed(const vector<char>& frame)
+{
+    const auto* h = reinterpret_cast<const ReplayFrameHeader*>(frame.data());
+    size_t tank_count = last_health.size();
+
+    const char* p = frame.data() + sizeof(ReplayFrameHeader);
+    const auto* x = reinterpret_cast<const float*>(p);
+    const auto* y = reinterpret_cast<const float*>(p + Pad4(tank_count * sizeof(float)));
+    const auto* health = reinterpret_cast<const int16_t*>(p + 2 * Pad4(tank_count * sizeof(float)));
+    const char* spawned = p + 2 * Pad4(tank_count * sizeof(float)) + Pad4(tank_count * sizeof(int16_t));
+
+    bool keyframe = frames_since_keyframe == 0;
+    if (!keyframe)
+    {
+        //Store the tank columns as deltas to the previous frame, fall back to a keyframe when a delta does not fit
+        encoded.resize(sizeof(ReplayFrameHeader));
+        deltas.resize(tank_count);
+
+        auto append_deltas = [&](const float* values, vector<int32_t>& last) {
+            for (size_t i = 0; i < tank_count; ++i)
+            {
+                int32_t delta = ToFixed(values[i]) - last[i];
+                if (delta < INT16_MIN || delta > INT16_MAX) return false;
+                deltas[i] = (int16_t)delta;
+            }
+            AppendPlanes(encoded, deltas.data(), tank_count);
+            return true;
+        };
+
+        keyframe = !append_deltas(x, last_x) || !append_deltas(y, last_y);
+        if (!keyframe)
+        {
+            for (size_t i = 0; i < tank_count; ++i) deltas[i] = (int16_t)(health[i] - last_health[i]);
+            AppendPlanes(encoded, deltas.data(), tank_count);
+
+            encoded.insert(encoded.end(), spawned, frame.data() + frame.size());
+
+            ReplayFrameHeader delta_header = *h;
+            delta_header.size = (uint32_t)encoded.size();
+            memcpy(encoded.data(), &delta_header, sizeof(delta_header));
+        }
+    }
+
+    if (keyframe)
+    {
+        encoded.assign(frame.begin(), frame.end());
+        frames_since_keyframe = 0;
+    }
+
+    //Deltas are taken between rounded positions so the reader does not drift
+    for (size_t i = 0; i < tank_count; ++i)
+    {
+        last_x[i] = ToFixed(x[i]);
+        last_y[i] = ToFixed(y[i]);
+    }
+    memcpy(last_health.data(), health, tank_count * sizeof(int16_t));
+    frames_since_keyframe = (frames_since_keyframe + 1) % keyframe_interval;
+
+    uLongf compressed_size = compressBound((uLong)encoded.size());
+    compressed.resize(sizeof(ReplayBlockHeader) + compressed_size);
+    compress2(reinterpret_cast<Bytef*>(compressed.data() + sizeof(ReplayBlockHeader)), &compressed_size,
+              reinterpret_cast<const Bytef*>(encoded.data()), (uLong)encoded.size(), Z_BEST_SPEED);
+
+    ReplayBlockHeader block = {};
+    block.compressed_size = (uint32_t)compressed_size;
+    block.raw_size = (uint32_t)encoded.size();
+    block.frame = h->frame;
+    block.keyframe = keyframe;
+    memcpy(compressed.data(), &block, sizeof(block));
+
+    fwrite(compressed.data(), 1, sizeof(block) + compressed_size, file);
+}
+
+ReplayReader::ReplayReader(const string& path)
+{
+#ifdef _WIN32
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_handle, &file_size);
+    size = (size_t)file_size.QuadPart;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr) return;
+    data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return;
+
+    struct stat st;
+    fstat(fd, &st);
+    size = (size_t)st.st_size;
+
+    if (size > 0)
+    {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = (const char*)mapped;
+    }
+    close(fd);
+#endif
+
+    if (data == nullptr) return;
+
+    header = reinterpret_cast<const ReplayHeader*>(data);
+    if (size < sizeof(ReplayHeader) || memcmp(header->magic, replay_magic, sizeof(replay_magic)) != 0 || header->version > replay_version)
+    {
+        cout << "Not a replay file " << path << endl;
+        Unmap();
+        return;
+    }
+
+    if (Pad4(header->tank_count) > size - sizeof(ReplayHeader))
+    {
+        cout << "Corrupt replay file " << path << endl;
+        Unmap();
+        return;
+    }
+    alliances = reinterpret_cast<const uint8_t*>(data + sizeof(ReplayHeader));
+    if (any_of(alliances, alliances + header->tank_count, [](uint8_t alliance) { return alliance > RED; }))
+    {
+        cout << "Corrupt replay file " << path << endl;
+        Unmap();
+        return;
+    }
+
+    // Index the frames, a frame that was cut off while writing is ignored
+    size_t offset = sizeof(ReplayHeader) + Pad4(header->tank_count);
+    if (IsCompressed())
+    {
+        while (offset + sizeof(ReplayBlockHeader) <= size)
+        {
+            const auto* block = reinterpret_cast<const ReplayBlockHeader*>(data + offset);
+            if (offset + sizeof(ReplayBlockHeader) + block->compressed_size > size) break;
+
+            if (block->keyframe) keyframes.push_back(frames.size());
+            frames.push_back(offset);
+            offset += sizeof(ReplayBlockHeader) + block->compressed_size;
+        }
+
+        //Delta frames can only be decoded forward from a keyframe
+        if (!frames.empty() && (keyframes.empty() || keyframes.front() != 0))
+        {
+            cout << "Corrupt replay file " << path << endl;
+            frames.clear();
+            keyframes.clear();
+            Unmap();
+            return;
+        }
+
+        fixed_x.resize(header->tank_count);
+        fixed_y.resize(header->tank_count);
+        x.resize(header->tank_count);
+        y.resize(header->tank_count);
+        health.resize(header->tank_count);
+        return;
+    }
+
+    while (offset + sizeof(ReplayFrameHeader) <= size)
+    {
+        const auto* frame = reinterpret_cast<const ReplayFrameHeader*>(data + offset);
+        if (frame->size < sizeof(ReplayFrameHeader) || offset + frame->size > size) break;
+
+        //A frame whose counts need more columns than it holds is skipped
+        if (sizeof(ReplayFrameHeader) + TankColumnBytes(header->tank_count, false) + SpawnedColumnBytes(*frame) <= frame->size)
+            frames.push_back(offset);
+        offset += frame->size;
+    }
+}
+
+ReplayReader::~ReplayReader() { Unmap(); }
+
+void ReplayReader::Unmap()
+{
+    if (data == nullptr) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+#else
+    munmap((void*)data, size);
+#endif
+    //Both point into the mapping
+    data = nullptr;
+    header = nullptr;
+    alliances = nullptr;
+}
+
+bool ReplayReader::DecodeBlock(size_t index) const
+{
+    const auto* block = reinterpret_cast<const ReplayBlockHeader*>(data + frames[index]);
+    size_t count = header->tank_count;
+    if (block->raw_size < sizeof(ReplayFrameHeader) + TankColumnBytes(count, !block->keyframe))
+    {
+        cout << "Corrupt replay frame " << block->frame << endl;
+        decoded = SIZE_MAX;
+        return false;
+    }
+    raw.resize(block->raw_size);
+
+    uLongf raw_size = block->raw_size;
+    if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &raw_size, reinterpret_cast<const Bytef*>(block + 1), block->compressed_size) != Z_OK ||
+        raw_size != block->raw_size)
+    {
+        cout << "Corrupt replay frame " << block->frame << endl;
+        decoded = SIZE_MAX;
+        return false;
+    }
+
+    const char* p = raw.data() + sizeof(ReplayFrameHeader);
+    if (block->keyframe)
+    {
+        size_t column = Pad4(count * sizeof(float));
+        memcpy(x.data(), p, count * sizeof(float));
+        memcpy(y.data(), p + column, count * sizeof(float));
+        memcpy(health.data(), p + 2 * column, count * sizeof(int16_t));
+        for (size_t i = 0; i < count; ++i)
+        {
+            fixed_x[i] = ToFixed(x[i]);
+            fixed_y[i] = ToFixed(y[i]);
+        }
+        spawned_offset = sizeof(ReplayFrameHeader) + 2 * column + Pad4(count * sizeof(int16_t));
+    }
+    else
+    {
+        size_t plane = Pad4(count * sizeof(int16_t));
+        for (size_t i = 0; i < count; ++i)
+        {
+            fixed_x[i] += ReadPlanes(p, count, i);
+            fixed_y[i] += ReadPlanes(p + plane, count, i);
+            x[i] = FromFixed(fixed_x[i]);
+            y[i] = FromFixed(fixed_y[i]);
+            health[i] += ReadPlanes(p + 2 * plane, count, i);
+        }
+        spawned_offset = sizeof(ReplayFrameHeader) + 3 * plane;
+    }
+
+    if (spawned_offset + SpawnedColumnBytes(*reinterpret_cast<const ReplayFrameHeader*>(raw.data())) > raw.size())
+    {
+        cout << "Corrupt replay frame " << block->frame << endl;
+        decoded = SIZE_MAX;
+        return false;
+    }
+
+    decoded = index;
+    return true;
+}
+
+ReplayFrame ReplayReader::GetFrame(size_t index) const
+{
+    if (IsCompressed())
+    {
+        if (index >= frames.size() || keyframes.empty() || index < keyframes.front()) return {};
+
+        //Continue from the last decoded frame when it lies between the keyframe and the requested frame
+        size_t keyframe = *(upper_bound(keyframes.begin(), keyframes.end(), index) - 1);
+        size_t next = decoded != SIZE_MAX && decoded >= keyframe && decoded <= index ? decoded + 1 : keyframe;
+        for (size_t i = next; i <= index; ++i)
+            if (!DecodeBlock(i)) return {};
+    }
+
+    const char* p = IsCompressed() ? raw.data() : data + frames[index];
+    const auto* h = reinterpret_cast<const ReplayFrameHeader*>(p);
+    p += sizeof(ReplayFrameHeader);
+
+    // Walk over the columns in the order they were written
+    auto column = [&p](size_t count, size_t element_size) {
+        const char* start = p;
+        p += Pad4(count * element_size);
+        return start;
+    };
+
+    ReplayFrame f = {};
+    f.frame = h->frame;
+    f.tank_count = header->tank_count;
+    if (IsCompressed())
+    {
+        f.tank_x = x.data();
+        f.tank_y = y.data();
+        f.tank_health = health.data();
+        p = raw.data() + spawned_offset;
+    }
+    else
+    {
+        f.tank_x = (const float*)column(f.tank_count, sizeof(float));
+        f.tank_y = (const float*)column(f.tank_count, sizeof(float));
+        f.tank_health = (const int16_t*)column(f.tank_count, sizeof(int16_t));
+    }
+
+    f.rocket_count = h->rocket_count;
+    f.rocket_x = (const float*)column(f.rocket_count, sizeof(float));
+    f.rocket_y = (const float*)column(f.rocket_count, sizeof(float));
+    f.rocket_speed_x = (const float*)column(f.rocket_count, sizeof(float));
+    f.rocket_speed_y = (const float*)column(f.rocket_count, sizeof(float));
+    f.rocket_alliance = (const uint8_t*)column(f.rocket_count, sizeof(uint8_t));
+
+    f.explosion_count = h->explosion_count;
+    f.explosion_x = (const float*)column(f.explosion_count, sizeof(float));
+    f.explosion_y = (const float*)column(f.explosion_count, sizeof(float));
+
+    f.smoke_count = h->smoke_count;
+    f.smoke_x = (const float*)column(f.smoke_count, sizeof(float));
+    f.smoke_y = (const float*)column(f.smoke_count, sizeof(float));
+    return f;
+}
+} // namespace PP2
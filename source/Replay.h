@@ -0,0 +1,190 @@
+#pragma once
+
+#include "explosion.h"
+#include "rocket.h"
+#include "smoke.h"
+#include "tank.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Replay file layout, all sections are padded to 4 bytes so the columns can be used in place:
+ *   ReplayHeader
+ *   uint8_t alliance[tank_count]
+ *   per frame:
+ *     ReplayFrameHeader
+ *     float tank_x[tank_count], float tank_y[tank_count], int16_t tank_health[tank_count]
+ *     float rocket_x[n], rocket_y[n], rocket_speed_x[n], rocket_speed_y[n], uint8_t rocket_alliance[n]
+ *     float explosion_x[n], explosion_y[n]
+ *     float smoke_x[n], smoke_y[n]
+ * Rockets, explosions and smokes are the ones spawned during that frame. A tank is active while its health is above 0
+ *
+ * When keyframe_interval is not 0 every frame is instead stored as a ReplayBlockHeader followed by a zlib compressed frame.
+ * Every keyframe_interval frames that frame is a keyframe with the layout above, the frames in between replace the
+ * tank columns with int16_t deltas of x, y (in 1/256 pixel) and health, stored as a plane of low bytes followed by a
+ * plane of high bytes. Positions in delta frames are rounded to 1/256 pixel
+ */
+struct ReplayHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t tank_count;
+    uint32_t keyframe_interval; // 0 for an uncompressed replay
+};
+
+struct ReplayFrameHeader
+{
+    uint32_t size; // bytes of this frame including the header
+    uint32_t frame;
+    uint32_t rocket_count;
+    uint32_t explosion_count;
+    uint32_t smoke_count;
+};
+
+struct ReplayBlockHeader
+{
+    uint32_t compressed_size; // bytes of zlib data following this header
+    uint32_t raw_size;
+    uint32_t frame;
+    uint32_t keyframe;
+};
+
+/**
+ * Appends the state of every frame to a replay file, the file is written by a background thread
+ */
+class ReplayRecorder
+{
+  public:
+    /**
+     * @param order Index in tanks of every tank in the order the replay lists them, so the replay stays the same when
+     *              the tanks are reordered in memory
+     * @param keyframe_interval Compress the replay with a keyframe every this many frames, 0 writes every frame in full
+     */
+    ReplayRecorder(const std::string& path, const std::vector<Tank>& tanks, const std::vector<uint32_t>& order,
+                   uint32_t keyframe_interval = 0);
+
+    /**
+     * Flushes the frames that are still queued and closes the file
+     */
+    ~ReplayRecorder();
+
+    bool IsOpen() const { return file != nullptr; }
+
+    /**
+     * Queue the frame, entities from the given index onwards were spawned this frame
+     */
+    void RecordFrame(long long frame, const std::vector<Tank>& tanks, const std::vector<uint32_t>& order,
+                     const std::vector<Rocket>& rockets, size_t first_rocket,
+                     const std::vector<Explosion>& explosions, size_t first_explosion,
+                     const std::vector<Smoke>& smokes, size_t first_smoke);
+
+  private:
+    void WriterThread();
+
+    void WriteCompressed(const std::vector<char>& frame);
+
+    FILE* file = nullptr;
+
+    // Compression state, only used by the writer thread
+    uint32_t keyframe_interval;
+    uint32_t frames_since_keyframe = 0;
+    std::vector<int32_t> last_x, last_y;
+    std::vector<int16_t> last_health;
+    std::vector<int16_t> deltas;
+    std::vector<char> encoded, compressed;
+
+    std::thread writer;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    std::deque<std::vector<char>> queue;
+    std::vector<std::vector<char>> free_buffers; // recycled so recording does not allocate every frame
+    bool stop = false;
+};
+
+/**
+ * A frame of a replay, all pointers point into the memory mapped file
+ */
+struct ReplayFrame
+{
+    uint32_t frame;
+    uint32_t tank_count;
+    const float* tank_x;
+    const float* tank_y;
+    const int16_t* tank_health;
+
+    uint32_t rocket_count;
+    const float* rocket_x;
+    const float* rocket_y;
+    const float* rocket_speed_x;
+    const float* rocket_speed_y;
+    const uint8_t* rocket_alliance;
+
+    uint32_t explosion_count;
+    const float* explosion_x;
+    const float* explosion_y;
+
+    uint32_t smoke_count;
+    const float* smoke_x;
+    const float* smoke_y;
+};
+
+/**
+ * Memory maps a replay file for zero-copy access to its frames
+ * Frames of a compressed replay are decoded from the nearest keyframe, reading them in order decodes one frame per call
+ */
+class ReplayReader
+{
+  public:
+    explicit ReplayReader(const std::string& path);
+    ~ReplayReader();
+
+    bool IsOpen() const { return data != nullptr; }
+
+    uint32_t TankCount() const { return header ? header->tank_count : 0; }
+
+    const uint8_t* Alliances() const { return alliances; }
+
+    size_t FrameCount() const { return frames.size(); }
+
+    bool IsCompressed() const { return header && header->keyframe_interval != 0; }
+
+    /**
+     * The pointers of a compressed frame stay valid until the next call
+     * A compressed frame that does not decode comes back empty, with a tank_count of 0
+     */
+    ReplayFrame GetFrame(size_t index) const;
+
+  private:
+    void Unmap();
+
+    bool DecodeBlock(size_t index) const;
+
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+
+    const ReplayHeader* header = nullptr;
+    const uint8_t* alliances = nullptr;
+    std::vector<size_t> frames; // offset of every frame
+    std::vector<size_t> keyframes; // index of every keyframe of a compressed replay
+
+    // The last decoded frame of a compressed replay
+    mutable size_t decoded = SIZE_MAX;
+    mutable std::vector<char> raw;
+    mutable std::vector<int32_t> fixed_x, fixed_y;
+    mutable std::vector<float> x, y;
+    mutable std::vector<int16_t> health;
+    mutable size_t spawned_offset = 0;
+};
+} // namespace PP2
@@ -0,0 +1,97 @@
+#include "StateHash.h"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+namespace PP2
+{
+StateHashLog::StateHashLog(const string& path, int interval) : interval(max(interval, 1))
+{
+    file = fopen(path.c_str(), "w");
+    if (file == nullptr) cout << "Could not open hash file " << path << endl;
+}
+
+StateHashLog::~StateHashLog()
+{
+    if (file != nullptr) fclose(file);
+}
+
+void StateHashLog::Write(long long frame, uint64_t hash)
+{
+    fprintf(file, "%lld %016llx\n", frame, (unsigned long long)hash);
+}
+
+//False with a message when the file cannot be opened or a line is not a frame followed by a hexadecimal hash
+static bool ReadHashLog(const string& path, map<long long, uint64_t>& hashes)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        cout << "Could not open hash file " << path << endl;
+        return false;
+    }
+
+    string line;
+    for (size_t number = 1; getline(in, line); ++number)
+    {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        const char* end = line.data() + line.size();
+        long long frame;
+        uint64_t hash;
+        auto parsed = from_chars(line.data(), end, frame);
+        bool ok = parsed.ec == errc() && parsed.ptr != end && *parsed.ptr == ' ';
+        if (ok)
+        {
+            parsed = from_chars(parsed.ptr + 1, end, hash, 16);
+            ok = parsed.ec == errc() && parsed.ptr == end;
+        }
+        if (!ok)
+        {
+            cout << "Hash file " << path << " has a bad line " << number << endl;
+            return false;
+        }
+        hashes[frame] = hash;
+    }
+    return true;
+}
+
+long long FirstDivergentFrame(const string& path_a, const string& path_b, size_t* compared)
+{
+    if (compared != nullptr) *compared = 0;
+
+    map<long long, uint64_t> a, b;
+    if (!ReadHashLog(path_a, a) || !ReadHashLog(path_b, b)) return -2;
+
+    //The runs may have hashed at different intervals or for a different number of frames, only frames both have count
+    size_t count = 0;
+    long long divergent = -1;
+    for (const auto& [frame, hash] : a)
+    {
+        auto other = b.find(frame);
+        if (other == b.end()) continue;
+
+        ++count;
+        if (other->second != hash)
+        {
+            divergent = frame;
+            break;
+        }
+    }
+
+    if (compared != nullptr) *compared = count;
+
+    //Nothing compared is no evidence the runs agree
+    if (count == 0)
+    {
+        cout << "Hash files " << path_a << " and " << path_b << " have no frame in common" << endl;
+        return -2;
+    }
+    return divergent;
+}
+} // namespace PP2
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "rocket.h"
+#include "tank.h"
+#include "template.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace PP2
+{
+/**
+ * 64-bit hash of the battle state, floats are hashed by their bits so any change in the simulation shows up
+ */
+class StateHash
+{
+  public:
+    void Add(uint32_t value)
+    {
+        hash ^= value;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+
+    void Add(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        Add(bits);
+    }
+
+    void Add(const vec2<>& value)
+    {
+        Add(value.x);
+        Add(value.y);
+    }
+
+    uint64_t Value() const
+    {
+        uint64_t z = hash;
+        z = (z ^ (z >> 33)) * 0xC4CEB9FE1A85EC53ull;
+        return z ^ (z >> 33);
+    }
+
+    /**
+     * The part of a tank that HashState of Game covers: position, health and active flag
+     */
+    void Add(const Tank& tank)
+    {
+        Add(tank.position);
+        Add((uint32_t)tank.health);
+        Add((uint32_t)tank.active);
+    }
+
+    void Add(const Rocket& rocket)
+    {
+        Add(rocket.position);
+        Add(rocket.speed);
+        Add((uint32_t)rocket.allignment);
+    }
+
+  private:
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+};
+
+/**
+ * Writes a "frame hash" line every interval frames
+ */
+class StateHashLog
+{
+  public:
+    StateHashLog(const std::string& path, int interval);
+    ~StateHashLog();
+
+    bool IsOpen() const { return file != nullptr; }
+
+    bool Due(long long frame) const { return frame % interval == 0; }
+
+    void Write(long long frame, uint64_t hash);
+
+  private:
+    FILE* file = nullptr;
+    int interval;
+};
+
+/**
+ * Compare two hash logs frame by frame
+ * @param compared Receives the number of frames both logs have
+ * @return The first frame whose hash differs, -1 when all frames both logs have agree, -2 when a log could not be
+ * read or the logs have no frame in common
+ */
+long long FirstDivergentFrame(const std::string& path_a, const std::string& path_b, size_t* compared = nullptr);
+} // namespace PP2
@@ -0,0 +1,599 @@
+#include "Strips.h"
+#include "Random.h"
+#include "StateHash.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PP2
+{
+#ifdef _WIN32
+bool RunStrips(const StripConfig&, float*)
+{
+    cout << "Strips need fork, which is not available on Windows" << endl;
+    return false;
+}
+#else
+static_assert(atomic<uint64_t>::is_always_lock_free && atomic<uint32_t>::is_always_lock_free,
+              "atomics shared between processes have to be lock free");
+
+static const int max_beams = 16;
+static const int columns = GRID_SIZE + 1;
+
+/**
+ * Barrier between processes, poll is called while waiting so the rings keep draining
+ */
+struct SharedBarrier
+{
+    atomic<uint32_t> arrived{0};
+    atomic<uint32_t> generation{0};
+    uint32_t count = 0;
+
+    template <class F>
+    void Wait(F poll)
+    {
+        uint32_t current = generation.load();
+        if (arrived.fetch_add(1) + 1 == count)
+        {
+            arrived.store(0);
+            generation.fetch_add(1);
+            return;
+        }
+        while (generation.load() == current)
+        {
+            poll();
+            sched_yield();
+        }
+    }
+};
+
+/**
+ * Byte ring from one process to another, head and tail count every byte ever written and read
+ */
+struct alignas(64) Ring
+{
+    atomic<uint64_t> head{0};
+    char head_padding[56];
+    atomic<uint64_t> tail{0};
+    char tail_padding[56];
+    uint64_t capacity = 0;
+
+    char* Data() { return reinterpret_cast<char*>(this + 1); }
+
+    void CopyIn(uint64_t position, const void* in, size_t bytes)
+    {
+        size_t offset = position % capacity, first = min<size_t>(bytes, capacity - offset);
+        memcpy(Data() + offset, in, first);
+        memcpy(Data(), (const char*)in + first, bytes - first);
+    }
+
+    void CopyOut(uint64_t position, void* out, size_t bytes)
+    {
+        size_t offset = position % capacity, first = min<size_t>(bytes, capacity - offset);
+        memcpy(out, Data() + offset, first);
+        memcpy((char*)out + first, Data(), bytes - first);
+    }
+};
+
+struct MessageHeader
+{
+    uint32_t type;
+    uint32_t bytes;
+};
+
+struct SharedHeader
+{
+    SharedBarrier barrier;
+    uint32_t beam_count = 0;
+    float seconds = 0.f;
+};
+
+/**
+ * Where everything is in the mapping, the same in every process
+ */
+struct SharedLayout
+{
+    size_t tanks;
+    size_t beams;
+    size_t rings;
+    size_t ring_stride;
+    size_t bytes;
+
+    SharedLayout(size_t tank_count, int processes, size_t ring_bytes)
+    {
+        auto align = [](size_t offset) { return (offset + 63) & ~(size_t)63; };
+        tanks = align(sizeof(SharedHeader));
+        beams = align(tanks + tank_count * sizeof(Tank));
+        rings = align(beams + max_beams * sizeof(Particle_beam));
+        ring_stride = align(sizeof(Ring) + ring_bytes);
+        bytes = rings + (size_t)processes * processes * ring_stride;
+    }
+};
+
+/**
+ * A rocket with the frame and tank that fired it, together the position it has in the rocket vector of Game
+ */
+struct RocketRecord
+{
+    //Plain floats rather than vec2, the records are copied through the rings with memcpy
+    float x;
+    float y;
+    float speed_x;
+    float speed_y;
+    float collision_radius;
+    int32_t id;
+    uint32_t alliance;
+    int32_t current_frame;
+    uint32_t frame;
+    uint32_t shooter;
+
+    bool operator<(const RocketRecord& other) const { return frame != other.frame ? frame < other.frame : shooter < other.shooter; }
+};
+static_assert(is_trivially_copyable<RocketRecord>::value, "RocketRecord is sent as raw bytes");
+
+struct StripRocket
+{
+    Rocket rocket;
+    uint32_t frame;
+    uint32_t shooter;
+};
+
+/**
+ * One process of a strip run
+ */
+class StripWorker
+{
+  public:
+    StripWorker(const StripConfig& config, char* shared, int rank)
+        : config(config), layout(config.num_blue + config.num_red, config.processes, config.ring_bytes), shared(shared),
+          header(reinterpret_cast<SharedHeader*>(shared)), tanks(reinterpret_cast<Tank*>(shared + layout.tanks)),
+          tank_count(config.num_blue + config.num_red), rank(rank), processes(config.processes)
+    {
+    }
+
+    void Run()
+    {
+        tbb::global_control control(tbb::global_control::max_allowed_parallelism, max(config.threads_per_process, 1));
+
+        //The first process spawns the armies exactly like Game, the others wait for them
+        auto* shared_beams = reinterpret_cast<Particle_beam*>(shared + layout.beams);
+        if (rank == 0)
+        {
+            Game game;
+            game.SetDeterministic(true, config.seed);
+            game.SetParameters(config.parameters);
+            game.Init(config.num_blue, config.num_red);
+            for (size_t i = 0; i < tank_count; ++i) new (&tanks[i]) Tank(game.GetTanks()[i]);
+            header->beam_count = (uint32_t)min<size_t>(game.GetParticleBeams().size(), max_beams);
+            for (uint32_t b = 0; b < header->beam_count; ++b) new (&shared_beams[b]) Particle_beam(game.GetParticleBeams()[b]);
+        }
+        Sync();
+
+        beams.assign(shared_beams, shared_beams + header->beam_count);
+        for (size_t i = 0; i < tank_count; ++i) (tanks[i].alliance == RED ? red_tanks : blue_tanks).push_back(&tanks[i]);
+        SplitColumns();
+
+        //Every process starts with the same grid as Game, limited to its strip and halo
+        grid = make_unique<Grid>(min<size_t>(tank_count, 500));
+        for (size_t i = 0; i < tank_count; ++i)
+            if (tanks[i].gridCell.x >= first_column - 1 && tanks[i].gridCell.x <= end_column) grid->AddTankToGridCell(&tanks[i]);
+
+        unique_ptr<StateHashLog> hash_log;
+        if (rank == 0 && !config.hash_path.empty()) hash_log = make_unique<StateHashLog>(config.hash_path, config.hash_every);
+
+        timer run;
+        for (uint32_t frame = 0; frame < (uint32_t)config.frames; ++frame)
+        {
+            //Every process takes part in a hash, only the first one writes it
+            bool hash = !config.hash_path.empty() && frame % max(config.hash_every, 1) == 0;
+            Frame(frame, hash);
+            if (hash_log && hash) hash_log->Write(frame, HashState());
+        }
+        Sync();
+        if (rank == 0) header->seconds = run.elapsed() / 1000.f;
+    }
+
+  private:
+    enum MessageType
+    {
+        ROCKETS, // RocketRecord of rockets that flew into the strip of the receiver
+        HITS,    // index of a tank of the receiver that was hit
+        TANKS,   // index of a tank that drove into the strip of the receiver
+        HALO,    // indices of the tanks in the border column of the sender, by cell
+        EXPORT,  // RocketRecord of every rocket, for the hash written by the first process
+        MESSAGE_TYPES
+    };
+
+    const StripConfig& config;
+    SharedLayout layout;
+    char* shared;
+    SharedHeader* header;
+    Tank* tanks;
+    size_t tank_count;
+    int rank;
+    int processes;
+
+    //Strip of this process, the columns of the other processes are only kept one deep as halo
+    int first_column = 0;
+    int end_column = 0;
+    int owner[columns];
+
+    unique_ptr<Grid> grid;
+    vector<Particle_beam> beams;
+    vector<Tank*> red_tanks;
+    vector<Tank*> blue_tanks;
+    unique_ptr<KD_Tree> red_tree;
+    unique_ptr<KD_Tree> blue_tree;
+    vector<StripRocket> rockets;
+
+    vector<char> inbox[MESSAGE_TYPES];
+
+    Ring* RingBetween(int from, int to)
+    {
+        return reinterpret_cast<Ring*>(shared + layout.rings + (size_t)(from * processes + to) * layout.ring_stride);
+    }
+
+    void Sync()
+    {
+        header->barrier.Wait([this] { Poll(); });
+    }
+
+    //Move every complete message in the rings to this process into the inbox
+    void Poll()
+    {
+        for (int from = 0; from < processes; ++from)
+        {
+            if (from == rank) continue;
+            Ring* ring = RingBetween(from, rank);
+            uint64_t tail = ring->tail.load(memory_order_relaxed);
+            uint64_t head = ring->head.load(memory_order_acquire);
+            while (tail < head)
+            {
+                MessageHeader message;
+                ring->CopyOut(tail, &message, sizeof(message));
+                vector<char>& box = inbox[message.type];
+                box.resize(box.size() + message.bytes);
+                ring->CopyOut(tail + sizeof(message), box.data() + box.size() - message.bytes, message.bytes);
+                tail += sizeof(message) + message.bytes;
+            }
+            ring->tail.store(tail, memory_order_release);
+        }
+    }
+
+    //Messages are cut at record boundaries so none is larger than half a ring, a full ring waits for the receiver
+    template <class T>
+    void Send(int to, MessageType type, const vector<T>& records)
+    {
+        Ring* ring = RingBetween(rank, to);
+        size_t per_message = max<size_t>(1, (ring->capacity / 2 - sizeof(MessageHeader)) / sizeof(T));
+        for (size_t first = 0; first < records.size(); first += per_message)
+        {
+            MessageHeader message = {(uint32_t)type, (uint32_t)(min(per_message, records.size() - first) * sizeof(T))};
+            uint64_t head = ring->head.load(memory_order_relaxed);
+            while (ring->capacity - (head - ring->tail.load(memory_order_acquire)) < sizeof(message) + message.bytes)
+            {
+                Poll();
+                sched_yield();
+            }
+            ring->CopyIn(head, &message, sizeof(message));
+            ring->CopyIn(head + sizeof(message), records.data() + first, message.bytes);
+            ring->head.store(head + sizeof(message) + message.bytes, memory_order_release);
+        }
+    }
+
+    template <class T>
+    vector<T> Receive(MessageType type)
+    {
+        static_assert(is_trivially_copyable<T>::value, "only plain values can be received");
+        Poll();
+        vector<char>& box = inbox[type];
+        vector<T> records(box.size() / sizeof(T));
+        memcpy(records.data(), box.data(), records.size() * sizeof(T));
+        box.clear();
+        return records;
+    }
+
+    //Contiguous strips with about the same number of tanks and at least one column each
+    void SplitColumns()
+    {
+        size_t counts[columns] = {};
+        for (size_t i = 0; i < tank_count; ++i) counts[tanks[i].gridCell.x]++;
+
+        int column = 0;
+        size_t seen = 0;
+        for (int p = 0; p < processes; ++p)
+        {
+            int start = column;
+            size_t target = tank_count * (p + 1) / processes;
+            while (column < columns - (processes - 1 - p) && (column == start || seen < target || p == processes - 1))
+                seen += counts[column++];
+            for (int c = start; c < column; ++c) owner[c] = p;
+            if (p == rank)
+            {
+                first_column = start;
+                end_column = column;
+            }
+        }
+    }
+
+    int OwnerOf(const Tank& tank) const { return owner[tank.gridCell.x]; }
+
+    void Frame(uint32_t frame, bool hash)
+    {
+        if (frame % 200 == 0)
+        {
+            red_tree = make_unique<KD_Tree>(red_tanks);
+            blue_tree = make_unique<KD_Tree>(blue_tanks);
+        }
+
+        MoveRockets();
+        CollideRockets();
+        UpdateTanks(frame);
+        ExchangeHalo(hash);
+    }
+
+    static RocketRecord ToRecord(const StripRocket& r)
+    {
+        return {r.rocket.position.x, r.rocket.position.y, r.rocket.speed.x, r.rocket.speed.y, r.rocket.collision_radius, r.rocket.id, (uint32_t)r.rocket.allignment,
+                r.rocket.current_frame, r.frame, r.shooter};
+    }
+
+    static StripRocket FromRecord(const RocketRecord& r)
+    {
+        StripRocket rocket{Rocket(vec2<>(r.x, r.y), vec2<>(r.speed_x, r.speed_y), r.collision_radius, (alliances)r.alliance, nullptr, r.id), r.frame, r.shooter};
+        rocket.rocket.current_frame = r.current_frame;
+        return rocket;
+    }
+
+    //Fly every rocket and hand the ones that left the strip to the process they flew into
+    void MoveRockets()
+    {
+        vector<vector<RocketRecord>> leaving(processes);
+        size_t kept = 0;
+        for (StripRocket& r : rockets)
+        {
+            Rocket& rocket = r.rocket;
+            rocket.Tick();
+            if (rocket.position.x < -250 || rocket.position.y < -250 || rocket.position.x > 1750 || rocket.position.y > 1750) continue;
+
+            int to = owner[Grid::GetGridCell(rocket.position).x];
+            if (to != rank)
+                leaving[to].push_back(ToRecord(r));
+            else
+                rockets[kept++] = r;
+        }
+        rockets.erase(rockets.begin() + kept, rockets.end());
+
+        for (int p = 0; p < processes; ++p)
+            if (p != rank) Send(p, ROCKETS, leaving[p]);
+        Sync();
+        for (const RocketRecord& record : Receive<RocketRecord>(ROCKETS)) rockets.push_back(FromRecord(record));
+    }
+
+    //Every rocket is in the strip now, so its surrounding cells are in the strip or the halo
+    void CollideRockets()
+    {
+        struct RocketHits
+        {
+            Tank* tanks[9];
+            int count = 0;
+        };
+        vector<RocketHits> hits(rockets.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rockets.size()), [&](tbb::blocked_range<size_t> r) {
+            for (size_t i = r.begin(); i < r.end(); ++i)
+                CollideRocket(rockets[i].rocket, *grid, [&](Tank* tank) { hits[i].tanks[hits[i].count++] = tank; });
+        });
+
+        vector<uint32_t> own_hits;
+        vector<vector<uint32_t>> remote_hits(processes);
+        for (const RocketHits& rocket_hits : hits)
+            for (int h = 0; h < rocket_hits.count; ++h)
+            {
+                const Tank* tank = rocket_hits.tanks[h];
+                int to = OwnerOf(*tank);
+                (to == rank ? own_hits : remote_hits[to]).push_back((uint32_t)(tank - tanks));
+            }
+        rockets.erase(remove_if(rockets.begin(), rockets.end(), [](const StripRocket& r) { return !r.rocket.active; }), rockets.end());
+
+        for (int p = 0; p < processes; ++p)
+            if (p != rank) Send(p, HITS, remote_hits[p]);
+
+        //Nobody changes a tank before every rocket was checked against it
+        Sync();
+
+        //Every rocket does the same damage, so the order hits arrive in does not change the outcome
+        vector<uint32_t> received = Receive<uint32_t>(HITS);
+        own_hits.insert(own_hits.end(), received.begin(), received.end());
+        for (uint32_t index : own_hits)
+        {
+            Tank& tank = tanks[index];
+            if (tank.active) tank.hit(config.parameters.rocket_hit_value);
+        }
+    }
+
+    void UpdateTanks(uint32_t frame)
+    {
+        vector<uint32_t> updated;
+        for (int x = first_column; x < end_column; ++x)
+            for (auto& cell : grid->grid[x])
+                for (Tank* tank : cell)
+                    if (tank->active) updated.push_back((uint32_t)(tank - tanks));
+        sort(updated.begin(), updated.end());
+
+        //The neighbours apply their rocket hits first, wrecks are passed through so separating reads the active flags
+        Sync();
+
+        //Sweeps the halo columns too, in the same order as Game, but only pushes the tanks of the strip
+        SeparateTanks(*grid, first_column, end_column);
+
+        //The neighbours read the positions and active flags of the border tanks until they are done separating
+        Sync();
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, updated.size()), [&](tbb::blocked_range<size_t> r) {
+            for (size_t i = r.begin(); i < r.end(); ++i)
+            {
+                Tank& tank = tanks[updated[i]];
+                for (Particle_beam& beam : beams)
+                    if (beam.rectangle.intersectsCircle(tank.Get_Position(), tank.Get_collision_radius())) tank.hit(beam.damage);
+                tank.Tick(*grid);
+            }
+        });
+
+        vector<vector<uint32_t>> leaving(processes);
+        for (uint32_t index : updated)
+            if (OwnerOf(tanks[index]) != rank) leaving[OwnerOf(tanks[index])].push_back(index);
+        for (int p = 0; p < processes; ++p)
+            if (p != rank) Send(p, TANKS, leaving[p]);
+
+        //Aiming reads the positions of every tank
+        Sync();
+
+        for (uint32_t index : Receive<uint32_t>(TANKS)) grid->AddTankToGridCell(&tanks[index]);
+        grid->SortCells();
+
+        vector<Tank*> targets(updated.size(), nullptr);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, updated.size()), [&](tbb::blocked_range<size_t> r) {
+            for (size_t i = r.begin(); i < r.end(); ++i)
+            {
+                Tank& tank = tanks[updated[i]];
+                if (tank.Rocket_Reloaded()) targets[i] = tank.alliance == RED ? blue_tree->findClosestTank(&tank) : red_tree->findClosestTank(&tank);
+            }
+        });
+
+        //The tank that fired may have left the strip, its rocket follows next frame
+        for (size_t i = 0; i < updated.size(); ++i)
+        {
+            if (targets[i] == nullptr) continue;
+            Tank& tank = tanks[updated[i]];
+            rockets.push_back({Rocket(tank.position, (targets[i]->position - tank.position).normalized() * 3, ROCKET_RADIUS,
+                                      tank.alliance, nullptr, (int)CounterRandom(config.seed, updated[i], frame)),
+                               frame, updated[i]});
+            tank.Reload_Rocket();
+        }
+    }
+
+    //Give the neighbours the tanks of the border columns, in cell order, to rebuild their halo from
+    void ExchangeHalo(bool hash)
+    {
+        for (int x = 0; x < columns; ++x)
+            if (x < first_column || x >= end_column)
+                for (auto& cell : grid->grid[x]) cell.clear();
+
+        auto column = [&](int x) {
+            vector<uint32_t> indices;
+            for (auto& cell : grid->grid[x])
+                for (Tank* tank : cell) indices.push_back((uint32_t)(tank - tanks));
+            return indices;
+        };
+        if (first_column > 0) Send(owner[first_column - 1], HALO, column(first_column));
+        if (end_column < columns) Send(owner[end_column], HALO, column(end_column - 1));
+
+        if (hash && rank != 0)
+        {
+            vector<RocketRecord> records;
+            for (const StripRocket& r : rockets) records.push_back(ToRecord(r));
+            Send(0, EXPORT, records);
+        }
+
+        Sync();
+        for (uint32_t index : Receive<uint32_t>(HALO)) grid->AddTankToGridCell(&tanks[index]);
+    }
+
+    //Game::HashState over the tanks in the mapping and the rockets of every process in the order Game keeps them
+    uint64_t HashState()
+    {
+        vector<RocketRecord> records = Receive<RocketRecord>(EXPORT);
+        for (const StripRocket& r : rockets) records.push_back(ToRecord(r));
+        sort(records.begin(), records.end());
+
+        StateHash hash;
+        for (size_t i = 0; i < tank_count; ++i) hash.Add(tanks[i]);
+        hash.Add((uint32_t)records.size());
+        for (const RocketRecord& record : records) hash.Add(FromRecord(record).rocket);
+        return hash.Value();
+    }
+};
+
+bool RunStrips(const StripConfig& config, float* seconds)
+{
+    int processes = max(1, min(config.processes, GRID_SIZE + 1));
+    StripConfig strips = config;
+    strips.processes = processes;
+    strips.ring_bytes = max<size_t>(config.ring_bytes, 4096);
+
+    SharedLayout layout(strips.num_blue + strips.num_red, processes, strips.ring_bytes);
+    void* mapping = mmap(nullptr, layout.bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        cout << "Could not map " << layout.bytes << " bytes of shared memory" << endl;
+        return false;
+    }
+
+    char* shared = static_cast<char*>(mapping);
+    auto* header = new (shared) SharedHeader();
+    header->barrier.count = processes;
+    for (int r = 0; r < processes * processes; ++r)
+    {
+        auto* ring = new (shared + layout.rings + r * layout.ring_stride) Ring();
+        ring->capacity = strips.ring_bytes;
+    }
+
+    //Nothing buffered may be printed twice, and TBB must not run yet, its threads do not survive fork
+    cout.flush();
+    fflush(stdout);
+
+    vector<pid_t> workers;
+    for (int rank = 0; rank < processes; ++rank)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            StripWorker(strips, shared, rank).Run();
+            cout.flush();
+            _exit(0);
+        }
+        if (pid < 0)
+        {
+            cout << "Could not start strip process " << rank << endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    //A process that dies leaves the others waiting at a barrier forever, so stop them all
+    bool ok = workers.size() == (size_t)processes;
+    if (!ok)
+        for (pid_t worker : workers) kill(worker, SIGKILL);
+    for (size_t running = workers.size(); running > 0; --running)
+    {
+        int status = 0;
+        if (waitpid(-1, &status, 0) == -1) break;
+        if (ok && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+        {
+            cout << "A strip process failed" << endl;
+            ok = false;
+            for (pid_t worker : workers) kill(worker, SIGKILL);
+        }
+    }
+
+    if (seconds != nullptr) *seconds = header->seconds;
+    munmap(mapping, layout.bytes);
+    return ok;
+}
+#endif
+} // namespace PP2
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "game.h"
+#include <cstdint>
+#include <string>
+
+namespace PP2
+{
+/**
+ * A battle split over several processes on one machine, every process owns a strip of grid columns
+ */
+struct StripConfig
+{
+    int processes = 2;
+    //TBB threads inside every process
+    int threads_per_process = 1;
+    uint64_t seed = 0;
+    int num_blue = NUM_TANKS_BLUE;
+    int num_red = NUM_TANKS_RED;
+    int frames = MAX_FRAMES;
+    BattleParameters parameters;
+    //Bytes of every ring between two processes, a full ring only makes the sender wait
+    size_t ring_bytes = 1 << 20;
+    //Written by the first process like StartHashing of Game, empty writes no hashes
+    std::string hash_path;
+    int hash_every = 10;
+};
+
+/**
+ * Play a battle with the rules of the deterministic mode of Game over config.processes forked processes
+ *
+ * The tanks live in one shared memory mapping, each process updates the tanks in its strip of grid columns and
+ * keeps its own Grid of its columns plus one halo column on both sides. Per frame, through a ring in shared memory
+ * between every two processes:
+ *   rockets that fly into another strip move to the process that owns it
+ *   hits on tanks across the border go to the owner of the tank, which applies them
+ *   tanks that drive into another strip are handed to its owner
+ *   the tanks of the border columns go to the neighbours, which rebuild their halo columns from them
+ * Targeting is not local, the closest enemy can be anywhere, so every process builds the KD trees over all tanks
+ * and reads their positions straight from the mapping. The strips are split once at the start, with the same number
+ * of tanks in each. Hashes match Game in the deterministic mode, without neighbour lists, with the same seed for any
+ * number of processes
+ *
+ * Needs fork, on Windows it only reports that it is not supported
+ * @param seconds Receives the time the processes took for all frames
+ * @return False when a process failed
+ */
+bool RunStrips(const StripConfig& config, float* seconds = nullptr);
+} // namespace PP2
@@ -1,100 +1,417 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace PP2
 {
-class ThreadPool; //Forward declare
-
-class Worker;
+/**
+ * A unit of work, run is responsible for whatever context points to
+ */
+struct Task
+{
+    void (*run)(Task* task);
+    void* context;
+    size_t begin;
+    size_t end;
+};
 
-class Worker
+/**
+ * Chase-Lev work stealing deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+ * The owning thread pushes and pops at the bottom, other threads steal from the top without locking
+ */
+class WorkStealingDeque
 {
   public:
-    //Instantiate the worker class by passing and storing the threadpool as a reference
-    Worker(ThreadPool& s)
-        : pool(s) {}
+    explicit WorkStealingDeque(int64_t capacity = 1024)
+        : array(new Array(capacity)) {}
+
+    ~WorkStealingDeque()
+    {
+        delete array.load(std::memory_order_relaxed);
+        for (Array* old : retired) delete old;
+    }
+
+    //Only called by the owner
+    void Push(Task* task)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) a = Grow(a, b, t);
+
+        a->Put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    //Only called by the owner, returns the newest task
+    Task* Pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
 
-    inline void operator()();
+        if (t > b)
+        {
+            //Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task* task = a->Get(b);
+        if (t == b)
+        {
+            //Last task, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) task = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    //Called by any thread, returns the oldest task
+    Task* Steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        Task* task = array.load(std::memory_order_acquire)->Get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+        return task;
+    }
 
   private:
-    ThreadPool& pool;
+    struct Array
+    {
+        explicit Array(int64_t capacity)
+            : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {}
+
+        void Put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+
+        Task* Get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+
+        int64_t capacity; // always a power of two
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+    };
+
+    Array* Grow(Array* a, int64_t b, int64_t t)
+    {
+        auto* grown = new Array(a->capacity * 2);
+        for (int64_t i = t; i < b; ++i) grown->Put(i, a->Get(i));
+
+        //A thief may still be reading the old array, it is freed with the deque
+        retired.push_back(a);
+        array.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Array*> array;
+    std::vector<Array*> retired;
 };
 
+/**
+ * Work stealing thread pool
+ * Every worker owns a deque, tasks spawned on a worker go to its own deque and idle workers steal from the others.
+ * Tasks enqueued from outside the pool go through one shared queue.
+ */
 class ThreadPool
 {
   public:
     ThreadPool(size_t numThreads)
-        : stop(false)
+        : queues(numThreads + 1)
     {
-        for (size_t i = 0; i < numThreads; ++i) workers.push_back(std::thread(Worker(*this)));
+        for (auto& queue : queues) queue = std::make_unique<WorkStealingDeque>();
+        for (size_t i = 0; i < numThreads; ++i) workers.emplace_back([this, i] { WorkerLoop(i); });
     }
 
     ~ThreadPool()
     {
-        stop = true; // stop all threads
-        condition.notify_all();
+        {
+            std::scoped_lock lock(sleep_mutex);
+            stop = true; // stop all threads
+        }
+        wake.notify_all();
 
         for (auto& thread : workers) thread.join();
     }
 
+    size_t Size() const { return workers.size(); }
+
     template <class T>
     auto enqueue(T task) -> std::future<decltype(task())>
     {
-        //Wrap the function in a packaged_task so we can return a future object
-        auto wrapper = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        auto* job = new Job<T>(std::move(task));
+        auto future = job->promise.get_future();
+        Submit(&job->task);
+        return future;
+    }
 
-        //Scope to restrict critical section
+    /**
+     * Enqueue every task in [first, last) with one lock and one wake up
+     */
+    template <class It>
+    auto enqueue_bulk(It first, It last) -> std::vector<std::future<decltype((*first)())>>
+    {
+        using T = typename std::iterator_traits<It>::value_type;
+        std::vector<std::future<decltype((*first)())>> futures;
+        std::vector<Task*> tasks;
+        for (; first != last; ++first)
         {
-            //lock our queue and add the given task to it
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            auto* job = new Job<T>(*first);
+            futures.emplace_back(job->promise.get_future());
+            tasks.emplace_back(&job->task);
+        }
 
-            tasks.push_back([=] { (*wrapper)(); });
+        if (local_pool == this)
+        {
+            for (Task* task : tasks) local_queue->Push(task);
+        }
+        else
+        {
+            std::scoped_lock lock(shared_mutex);
+            shared_tasks.insert(shared_tasks.end(), tasks.begin(), tasks.end());
+            shared_count.store(shared_tasks.size(), std::memory_order_relaxed);
         }
+        Wake(true);
+        return futures;
+    }
+
+    /**
+     * Call body(begin, end) over sub ranges of [first, last), ranges are split in half until they are at most grain
+     * long and the halves are stolen by idle workers. The calling thread helps until every range is done.
+     * @param grain 0 picks a grain that gives every thread about 8 ranges
+     */
+    template <class F>
+    void parallel_for(size_t first, size_t last, F body, size_t grain = 0)
+    {
+        if (first >= last) return;
+        size_t count = last - first;
+        if (grain == 0) grain = std::max<size_t>(1, count / (8 * (workers.size() + 1)));
+
+        ForJob<F> job(this, body, grain, count);
+        Task root = {&RunRange<F>, &job, first, last};
 
-        //Wake up a thread to start this task
-        condition.notify_one();
+        //A thread from outside the pool borrows the spare deque, one at a time
+        std::unique_lock<std::mutex> external;
+        ThreadPool* outer_pool = local_pool;
+        WorkStealingDeque* outer_queue = local_queue;
+        bool outside = local_pool != this;
+        if (outside)
+        {
+            external = std::unique_lock<std::mutex>(external_mutex);
+            local_pool = this;
+            local_queue = queues.back().get();
+        }
 
-        return wrapper->get_future();
+        Wake(true);
+        RunRange<F>(&root);
+        while (job.remaining.load(std::memory_order_acquire) != 0)
+        {
+            Task* task = FindTask();
+            if (task != nullptr)
+                task->run(task);
+            else
+                std::this_thread::yield();
+        }
+
+        if (outside)
+        {
+            local_pool = outer_pool;
+            local_queue = outer_queue;
+        }
     }
 
   private:
-    friend class Worker; //Gives access to the private variables of this class
+    //A task owning a callable and the promise of its result, deletes itself after running
+    template <class T>
+    struct Job
+    {
+        explicit Job(T function)
+            : function(std::move(function)), task{&Run, this, 0, 0} {}
 
-    std::vector<std::thread> workers;
-    std::deque<std::function<void()>> tasks;
+        static void Run(Task* task)
+        {
+            auto* job = static_cast<Job*>(task->context);
+            try
+            {
+                if constexpr (std::is_void_v<decltype(job->function())>)
+                {
+                    job->function();
+                    job->promise.set_value();
+                }
+                else
+                    job->promise.set_value(job->function());
+            }
+            catch (...)
+            {
+                job->promise.set_exception(std::current_exception());
+            }
+            delete job;
+        }
 
-    std::condition_variable condition; //Wakes up a thread when work is available
+        T function;
+        std::promise<decltype(std::declval<T&>()())> promise;
+        Task task;
+    };
 
-    std::mutex queue_mutex; //Lock for our queue
-    bool stop = false;
-};
+    template <class F>
+    struct ForJob
+    {
+        ForJob(ThreadPool* pool, F& body, size_t grain, size_t count)
+            : pool(pool), body(body), grain(grain), remaining(count), tasks(2 * (count / grain) + 2) {}
 
-inline void Worker::operator()()
-{
-    std::function<void()> task;
-    while (true)
+        ThreadPool* pool;
+        F& body;
+        size_t grain;
+        std::atomic<size_t> remaining;
+        std::vector<Task> tasks; // storage for the split off halves, a split never needs more than this
+        std::atomic<size_t> next_task{0};
+    };
+
+    template <class F>
+    static void RunRange(Task* task)
     {
-        //Scope to restrict critical section
-        //This is important because we don't want to hold the lock while executing the task,
-        //because that would make it so only one task can be run simultaneously (aka sequantial)
+        auto* job = static_cast<ForJob<F>*>(task->context);
+        size_t begin = task->begin, end = task->end;
+
+        //Keep the left half and offer the right half to the other threads
+        while (end - begin > job->grain)
         {
-            std::unique_lock<std::mutex> locker(pool.queue_mutex);
+            size_t middle = begin + (end - begin) / 2;
+            Task* right = &job->tasks[job->next_task.fetch_add(1, std::memory_order_relaxed)];
+            *right = {&RunRange<F>, job, middle, end};
+            local_queue->Push(right);
+            job->pool->Wake(false);
+            end = middle;
+        }
 
-            //Wait until some work is ready or we are stopping the threadpool
-            //Because of spurious wakeups we need to check if there is actually a task available or we are stopping
-            pool.condition.wait(locker, [=] { return pool.stop || !pool.tasks.empty(); });
+        job->body(begin, end);
+        job->remaining.fetch_sub(end - begin, std::memory_order_release);
+    }
+
+    void Submit(Task* task)
+    {
+        if (local_pool == this)
+            local_queue->Push(task);
+        else
+        {
+            std::scoped_lock lock(shared_mutex);
+            shared_tasks.push_back(task);
+            shared_count.store(shared_tasks.size(), std::memory_order_relaxed);
+        }
+        Wake(false);
+    }
 
-            if (pool.stop) break;
+    //Own deque first, then the shared queue, then steal from a random other deque
+    Task* FindTask()
+    {
+        if (local_pool == this)
+            if (Task* task = local_queue->Pop()) return task;
 
-            task = pool.tasks.front();
-            pool.tasks.pop_front();
+        if (shared_count.load(std::memory_order_relaxed) != 0)
+        {
+            std::scoped_lock lock(shared_mutex);
+            if (!shared_tasks.empty())
+            {
+                Task* task = shared_tasks.front();
+                shared_tasks.pop_front();
+                shared_count.store(shared_tasks.size(), std::memory_order_relaxed);
+                return task;
+            }
         }
 
-        task();
+        thread_local uint32_t seed = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        size_t start = seed % queues.size();
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            WorkStealingDeque* victim = queues[(start + i) % queues.size()].get();
+            if (victim == local_queue) continue;
+            if (Task* task = victim->Steal()) return task;
+        }
+        return nullptr;
+    }
+
+    void Wake(bool all)
+    {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst) == 0) return;
+
+        std::scoped_lock lock(sleep_mutex);
+        if (all)
+            wake.notify_all();
+        else
+            wake.notify_one();
     }
-}
+
+    void WorkerLoop(size_t index)
+    {
+        local_pool = this;
+        local_queue = queues[index].get();
+
+        while (true)
+        {
+            //Read the epoch before looking, so work pushed after the last look always wakes us
+            uint64_t seen = epoch.load(std::memory_order_seq_cst);
+
+            Task* task = nullptr;
+            for (int spin = 0; spin < 64 && task == nullptr; ++spin)
+            {
+                task = FindTask();
+                if (task == nullptr) std::this_thread::yield();
+            }
+
+            if (task != nullptr)
+            {
+                task->run(task);
+                continue;
+            }
+
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                wake.wait(lock, [&] { return stop || epoch.load(std::memory_order_seq_cst) != seen; });
+                stopping = stop; //Read under the lock the destructor writes it with
+            }
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+
+            if (stopping) break;
+        }
+    }
+
+    static inline thread_local ThreadPool* local_pool = nullptr;
+    static inline thread_local WorkStealingDeque* local_queue = nullptr;
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkStealingDeque>> queues; // one per worker and a spare for an outside thread
+
+    std::mutex shared_mutex; //Lock for tasks enqueued from outside the pool
+    std::deque<Task*> shared_tasks;
+    std::atomic<size_t> shared_count{0};
+
+    std::mutex external_mutex; //Held by the outside thread using the spare deque
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake; //Wakes up sleeping workers when work is available
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<int> sleeping{0};
+    bool stop = false;
+};
 } // namespace PP2
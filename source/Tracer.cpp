@@ -0,0 +1,95 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+namespace PP2
+{
+Tracer* Tracer::Instance()
+{
+    static Tracer tracer;
+    return &tracer;
+}
+
+uint64_t Tracer::Now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::Configure(const string& trace_path, long long first, long long frame_count)
+{
+    path = trace_path;
+    first_frame = first;
+    last_frame = first + frame_count - 1;
+}
+
+void Tracer::BeginFrame(long long frame)
+{
+    if (frame == first_frame && !path.empty()) enabled.store(true, memory_order_relaxed);
+    if (frame == last_frame + 1 && Enabled()) Flush();
+}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        scoped_lock lock(buffers_mutex);
+        buffers.emplace_back(make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->tid = (int)buffers.size() - 1;
+        buffer->events.reset(new TraceEvent[RING_SIZE]);
+    }
+    return buffer;
+}
+
+void Tracer::Record(const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    buffer->events[buffer->next++ % RING_SIZE] = {name, begin_ns, end_ns};
+}
+
+// Only called between frames, when no worker is writing to its buffer
+void Tracer::Flush()
+{
+    enabled.store(false, memory_order_relaxed);
+
+    scoped_lock lock(buffers_mutex);
+
+    uint64_t origin = UINT64_MAX;
+    for (auto& buffer : buffers)
+        for (size_t i = 0; i < min(buffer->next, RING_SIZE); ++i) origin = min(origin, buffer->events[i].begin_ns);
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        cout << "Could not write trace to " << path << endl;
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (auto& buffer : buffers)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->tid);
+        first = false;
+
+        for (size_t i = 0; i < min(buffer->next, RING_SIZE); ++i)
+        {
+            const TraceEvent& e = buffer->events[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.name,
+                    buffer->tid, (e.begin_ns - origin) / 1000.0, (e.end_ns - e.begin_ns) / 1000.0);
+        }
+        buffer->next = 0;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    cout << "Trace written to " << path << endl;
+    path.clear();
+}
+} // namespace PP2
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "template.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace PP2
+{
+/**
+ * Records when every traced scope ran on which thread during a window of frames
+ * and writes it as Chrome trace-event JSON (open in Perfetto or chrome://tracing)
+ */
+class Tracer
+{
+  public:
+    static Tracer* Instance();
+
+    /**
+     * Trace a window of frames, the file is written when the window ends
+     * @param path File to write the trace to
+     * @param first_frame First frame to record
+     * @param frame_count Number of frames to record
+     */
+    void Configure(const std::string& path, long long first_frame, long long frame_count);
+
+    /**
+     * Called at the start of every frame to open and close the window
+     */
+    void BeginFrame(long long frame);
+
+    /**
+     * Stop recording and write what was recorded so far
+     */
+    void Flush();
+
+    /**
+     * Store a scope in the ring buffer of the calling thread
+     */
+    void Record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static uint64_t Now();
+
+  private:
+    // Events per thread, older events are overwritten once a thread fills its ring
+    static const size_t RING_SIZE = 1 << 16;
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+    };
+
+    struct ThreadBuffer
+    {
+        int tid;
+        std::unique_ptr<TraceEvent[]> events;
+        size_t next = 0;
+    };
+
+    Tracer() = default;
+
+    ThreadBuffer* GetThreadBuffer();
+
+    static inline std::atomic<bool> enabled{false};
+
+    std::string path;
+    long long first_frame = 0;
+    long long last_frame = -1;
+
+    std::mutex buffers_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+/**
+ * Records the lifetime of this object when the tracer is enabled
+ */
+class TraceScope
+{
+  public:
+    explicit TraceScope(const char* name)
+        : name(name), begin_ns(Tracer::Enabled() ? Tracer::Now() : 0) {}
+
+    ~TraceScope()
+    {
+        if (begin_ns != 0 && Tracer::Enabled()) Tracer::Instance()->Record(name, begin_ns, Tracer::Now());
+    }
+
+  private:
+    const char* name;
+    uint64_t begin_ns;
+};
+
+#define TRACE_SCOPE(_NAME_) TraceScope trace_scope(_NAME_)
+} // namespace PP2
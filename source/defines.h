@@ -24,6 +24,8 @@
 
 #define TANK_MAX_SPEED 1.5
 
+#define ROCKET_RADIUS 10.f
+
 #define HEALTH_BARS_OFFSET_X 0
 #define HEALTH_BAR_HEIGHT 70
 #define HEALTH_BAR_WIDTH 1
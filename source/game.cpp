@@ -8,13 +8,21 @@ using namespace std;
 #include <iostream>
 #include <mutex>
 #include <string>
+#include <tbb/flow_graph.h>
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <tbb/task_group.h>
 
 using namespace PP2;
 
 #include "Algorithms.h"
+#include "AssetPack.h"
+#include "Checkpoint.h"
+#include "Formation.h"
 #include "Grid.h"
+#include "NeighbourList.h"
+#include "Random.h"
+#include "Tracer.h"
 #include "defines.h"
 #include "explosion.h"
 #include "game.h"
@@ -30,20 +38,17 @@ using namespace PP2;
 #define PROFILE_PARALLEL 1
 #endif
 
-static timer perf_timer;
-static float duration;
-
-//Load sprite files and initialize sprites
-static SDL_Surface* background_img = SDL_LoadBMP("assets/Background_Grass.bmp");
-static SDL_Surface* tank_red_img = SDL_LoadBMP("assets/Tank_Proj2.bmp");
-static SDL_Surface* tank_blue_img = SDL_LoadBMP("assets/Tank_Blue_Proj2.bmp");
-static SDL_Surface* rocket_red_img = SDL_LoadBMP("assets/Rocket_Proj2.bmp");
-static SDL_Surface* rocket_blue_img = SDL_LoadBMP("assets/Rocket_Blue_Proj2.bmp");
-static SDL_Surface* particle_beam_img = SDL_LoadBMP("assets/Particle_Beam.bmp");
-static SDL_Surface* smoke_img = SDL_LoadBMP("assets/Smoke.bmp");
-static SDL_Surface* explosion_img = SDL_LoadBMP("assets/Explosion.bmp");
-
-FC_Font* GameFont;
+//Sprite files, loaded from the asset pack when there is one
+static const char* asset_pack_path = "assets/sprites.pack";
+static const vector<string> sprite_files = {
+    "assets/Background_Grass.bmp",
+    "assets/Tank_Proj2.bmp",
+    "assets/Tank_Blue_Proj2.bmp",
+    "assets/Rocket_Proj2.bmp",
+    "assets/Rocket_Blue_Proj2.bmp",
+    "assets/Particle_Beam.bmp",
+    "assets/Smoke.bmp",
+    "assets/Explosion.bmp"};
 
 SDL_Texture* tankThreads;
 SDL_Texture* tank_red;
@@ -58,15 +63,8 @@ const static vec2<> tank_size(14, 18);
 const static vec2<> rocket_size(25, 24);
 
 const static float tank_radius = 12.f;
-const static float rocket_radius = 10.f;
-
-vector<int> redHealthBars = {};
-vector<int> blueHealthBars = {};
-vector<SDL_Point> drawPoints = {};
+const static float rocket_radius = ROCKET_RADIUS;
 
-#define LOAD_TEX(_FIELD_) SDL_CreateTextureFromSurface(screen, _FIELD_);
-
-mutex tankVectorMutex;
 typedef unsigned int Pixel; // unsigned int is assumed to be 32-bit, which seems a safe assumption.
 
 // subtractive blending
@@ -84,86 +82,171 @@ Pixel SubBlend(Pixel a_Color1, Pixel a_Color2)
 // -----------------------------------------------------------
 // Initialize the application
 // -----------------------------------------------------------
-void Game::Init()
-{
-    //initiate grid to allocate memory
-    auto instance = Grid::Instance();
+//A few ranges per thread, so a worker that finishes early can still steal
+static size_t PartitionCount() { return 8 * (size_t)tbb::this_task_arena::max_concurrency(); }
 
-    tankThreads = SDL_CreateTexture(screen, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCRWIDTH, SCRHEIGHT);
-
-    tank_red = LOAD_TEX(tank_red_img);
-    tank_blue = LOAD_TEX(tank_blue_img);
-    rocket_red = LOAD_TEX(rocket_red_img);
-    rocket_blue = LOAD_TEX(rocket_blue_img);
-    smoke = LOAD_TEX(smoke_img);
-    explosion = LOAD_TEX(explosion_img);
-    particle_beam_sprite = LOAD_TEX(particle_beam_img);
-
-    GameFont = FC_CreateFont();
-    FC_LoadFont(GameFont, screen, "assets/digital-7.ttf", 72, FC_MakeColor(255, 255, 255, 255), TTF_STYLE_NORMAL);
+void Game::Init(int num_blue, int num_red)
+{
+    int count = num_blue + num_red;
 
-    Uint32* pixels = nullptr;
-    int pitch = 0;
-    // Now let's make our "pixels" pointer point to the texture data.
-    SDL_LockTexture(tankThreads, nullptr, (void**)&pixels, &pitch);
-    memcpy(pixels, background_img->pixels, SCRWIDTH * SCRHEIGHT * 4);
-    SDL_UnlockTexture(tankThreads);
+    //initiate grid to allocate memory, a small battle never puts more tanks in a cell than it has
+    grid = std::make_unique<Grid>(std::min(count, 500));
 
-    tanks.reserve(NUM_TANKS_BLUE + NUM_TANKS_RED);
-    blueTanks.reserve(NUM_TANKS_BLUE);
-    redTanks.reserve(NUM_TANKS_RED);
+    //Headless runs have no renderer to create textures with
+    if (screen != nullptr) LoadSprites();
 
-    uint max_rows = 12;
+    CostPartition spawn;
+    spawn.SetStatic(numa);
+    spawn.Build(count, PartitionCount(), [](size_t) { return 1; });
 
-    float start_blue_x = tank_size.x + 10.0f;
-    float start_blue_y = tank_size.y + 80.0f;
+    //Fault the pages in on every thread at once instead of one by one while the vector is filled, with numa the pages
+    //also end up on the node of the threads that update those tanks
+    tanks.reserve(count);
+    FirstTouch(tanks.data(), sizeof(Tank), spawn);
+    if (numa) PlaceMemory();
 
-    float start_red_x = 980.0f;
-    float start_red_y = 100.0f;
+    Formation blue = blue_formation ? blue_formation : BlockFormation(vec2<>(tank_size.x + 10.0f, tank_size.y + 80.0f));
+    Formation red = red_formation ? red_formation : BlockFormation(vec2<>(980.0f, 100.0f));
 
-    float spacing = 15.0f;
+    //Every tank of an army starts as a copy of the same tank and only gets its own position, blue first and red after
+    const Tank blue_tank(0, 0, BLUE, tank_blue, smoke, 1200, 600, tank_radius, TANK_MAX_HEALTH, parameters.tank_max_speed);
+    const Tank red_tank(0, 0, RED, tank_red, smoke, 80, 80, tank_radius, TANK_MAX_HEALTH, parameters.tank_max_speed);
 
-    //Spawn blue tanks
-    for (int i = 0; i < NUM_TANKS_BLUE; i++)
-    {
-        tanks.emplace_back(start_blue_x + ((i % max_rows) * spacing), start_blue_y + ((i / max_rows) * spacing), BLUE,
-                           tank_blue, smoke, 1200, 600, tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
-    }
-    //Spawn red tanks
-    for (int i = 0; i < NUM_TANKS_RED; i++)
-    {
-        tanks.emplace_back(start_red_x + ((i % max_rows) * spacing), start_red_y + ((i / max_rows) * spacing), RED,
-                           tank_red,
-                           smoke, 80, 80, tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
-    }
+    tanks.resize(count, blue_tank);
+    ParallelFor(spawn, [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i)
+        {
+            Tank& tank = tanks[i];
+            if (i >= num_blue) tank = red_tank;
+            tank.id = i;
+            tank.position = i < num_blue ? blue(i, num_blue) : red(i - num_blue, num_red);
+            tank.gridCell = Grid::GetGridCell(tank.position);
+        }
+    });
 
     particle_beams.emplace_back(vec2<>(SCRWIDTH / 2, SCRHEIGHT / 2), vec2<>(100, 50), particle_beam_sprite,
                                 PARTICLE_BEAM_HIT_VALUE);
     particle_beams.emplace_back(vec2<>(80, 80), vec2<>(100, 50), particle_beam_sprite, PARTICLE_BEAM_HIT_VALUE);
     particle_beams.emplace_back(vec2<>(1200, 600), vec2<>(100, 50), particle_beam_sprite, PARTICLE_BEAM_HIT_VALUE);
 
-    for (auto& tank : tanks)
-    {
-        instance->AddTankToGridCell(&tank);
-        if (tank.alliance == RED)
-            redTanks.emplace_back(&tank);
-        else
-            blueTanks.emplace_back(&tank);
-    }
+    grid->AddTanks(tanks);
+
+    //The armies were spawned one after the other, so their index lists are two plain ranges
+    blueTanks.resize(num_blue);
+    redTanks.resize(num_red);
+    tank_slots.resize(count);
+    ParallelFor(spawn, [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i)
+        {
+            tank_slots[i] = i;
+            if (i < num_blue)
+                blueTanks[i] = &tanks[i];
+            else
+                redTanks[i - num_blue] = &tanks[i];
+        }
+    });
+    live_tanks = count;
+    num_blue_tanks = num_blue;
+    num_red_tanks = num_red;
+
+    //A pair further apart than a cell is never in the lists, so the collision distance plus the skin has to fit in one
+    if (neighbour_skin > 0.f)
+        neighbours = std::make_unique<NeighbourList>(std::min(neighbour_skin, Grid::cell_size - sqrtf(2.f) * tank_radius));
 
     //    blue_KD_Tree = new KD_Tree(blueTanks);
     //    blue_KD_Tree->printTree();
 }
 
+void Game::SetPlacement(Pinning pinning, bool numa)
+{
+    Topology topology = Topology::Detect();
+    cout << "Placement over " << topology.nodes.size() << " NUMA node(s) and " << topology.CoreCount() << " core(s)" << endl;
+
+    //Placing memory by node only pays off when the threads stay on their node
+    if (numa && pinning == Pinning::NONE) pinning = Pinning::NODES;
+    affinity = std::make_unique<AffinityObserver>(pinning, std::move(topology));
+
+    this->numa = numa;
+    tank_partition.SetStatic(numa);
+    rocket_partition.SetStatic(numa);
+    column_partition.SetStatic(numa);
+}
+
+//Touch the reserved rockets and the grid cells from the threads that will update them, before the main thread
+//writes anything, so the OS puts every page on the node of its thread. Init touches the tanks itself
+void Game::PlaceMemory()
+{
+    grid->PlaceCells();
+
+    CostPartition placement;
+    placement.SetStatic(true);
+
+    //Rockets live about as long as it takes to cross the field, a slot per tank covers a full battle
+    rockets.reserve(tanks.capacity());
+    placement.Build(rockets.capacity(), tbb::this_task_arena::max_concurrency(), [](size_t) { return 1; });
+    FirstTouch(rockets.data(), sizeof(Rocket), placement);
+}
+
+bool Game::BuildAssetPack(const std::string& path)
+{
+    AssetPack assets;
+    return assets.LoadFiles(sprite_files) && assets.Write(path);
+}
+
+void Game::LoadSprites()
+{
+    //Both decode every sprite in parallel, only creating the textures has to happen on this thread
+    AssetPack assets;
+    if (!assets.Load(asset_pack_path)) assets.LoadFiles(sprite_files);
+
+    tankThreads = SDL_CreateTexture(screen, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCRWIDTH, SCRHEIGHT);
+
+    tank_red = assets.CreateTexture(screen, "Tank_Proj2.bmp");
+    tank_blue = assets.CreateTexture(screen, "Tank_Blue_Proj2.bmp");
+    rocket_red = assets.CreateTexture(screen, "Rocket_Proj2.bmp");
+    rocket_blue = assets.CreateTexture(screen, "Rocket_Blue_Proj2.bmp");
+    smoke = assets.CreateTexture(screen, "Smoke.bmp");
+    explosion = assets.CreateTexture(screen, "Explosion.bmp");
+    particle_beam_sprite = assets.CreateTexture(screen, "Particle_Beam.bmp");
+
+    font = FC_CreateFont();
+    FC_LoadFont(font, screen, "assets/digital-7.ttf", 72, FC_MakeColor(255, 255, 255, 255), TTF_STYLE_NORMAL);
+
+    const AssetPack::Image* background = assets.Find("Background_Grass.bmp");
+    Uint32* pixels = nullptr;
+    int pitch = 0;
+    // Now let's make our "pixels" pointer point to the texture data.
+    if (background == nullptr || SDL_LockTexture(tankThreads, nullptr, (void**)&pixels, &pitch) != 0) return;
+    for (int y = 0; y < min(background->height, SCRHEIGHT); ++y)
+        memcpy((char*)pixels + y * pitch, background->pixels.data() + y * background->width, min(background->width, SCRWIDTH) * 4);
+    SDL_UnlockTexture(tankThreads);
+}
+
 // -----------------------------------------------------------
 // Close down application
 // -----------------------------------------------------------
-void Game::Shutdown() {}
+void Game::Shutdown()
+{
+    //Print the frame time percentiles, spikes matter more than averages
+    phase_timer.Print(cout);
+
+    if (PerfCounters::Enabled()) PerfCounters::Instance()->Print(cout);
+
+    //Write the trace if the window was still open
+    if (Tracer::Enabled()) Tracer::Instance()->Flush();
+
+    //Write the frames that are still queued
+    recorder.reset();
+    hash_log.reset();
+}
 
 Game::~Game()
 {
     //delete frame_count_font;
-    FC_FreeFont(GameFont);
+    FC_FreeFont(font);
+
+    delete red_KD_Tree;
+    delete blue_KD_Tree;
 }
 
 // -----------------------------------------------------------
@@ -178,51 +261,99 @@ void Game::Update(float deltaTime)
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
-    if (frame_count % 200 == 0)
-    {
-        BuildKDTree();
-    }
+    Tracer::Instance()->BeginFrame(frame_count);
+    TRACE_SCOPE("Update");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE);
 
-    //Update particle beams
-    UpdateParticleBeams();
+    //Between frames only pointers to tanks are kept, no indices, so this is where the tanks can move
+    RemoveDestroyedTanks();
+    if (sort_interval > 0 && frame_count > 0 && frame_count % sort_interval == 0) SortTanks();
 
-    //Update smoke plumes
-    UpdateSmoke();
+    //Smokes behind this index are spawned this frame
+    first_smoke = smokes.size();
 
-    //Update explosion sprites
-    UpdateExplosions();
+    if (!update_graph) BuildUpdateGraph();
+    update_start->try_put(tbb::flow::continue_msg());
+    update_graph->wait_for_all();
 
-    //Remove when done with remove erase idiom
-    explosions.erase(std::remove_if(explosions.begin(), explosions.end(),
-                                    [](const Explosion& eExplosion) { return eExplosion.done(); }),
-                     explosions.end());
+    if (recorder) recorder->RecordFrame(frame_count, tanks, tank_slots, rockets, first_rocket, explosions, first_explosion, smokes, first_smoke);
 
-    //Update rockets
-    UpdateRockets();
+    if (hash_log && hash_log->Due(frame_count)) hash_log->Write(frame_count, HashState());
+}
+
+// -----------------------------------------------------------
+// The phases of a frame and what they touch, a phase starts as soon as the phases it depends on are done:
+//   BuildKDTree          reads tank positions and active flags, writes the KD trees
+//   UpdateParticleBeams  writes the particle beams
+//   UpdateSmoke          writes the smokes
+//   UpdateExplosions     writes and compacts the explosions
+//   UpdateRockets        writes rockets and tank health, appends smokes and explosions, so it waits for the
+//                        KD trees (active flags), the smokes and the explosions
+//   UpdateTanks          reads the KD trees and particle beams, writes tanks, appends rockets and smokes
+//   UpdateRed/BlueHP     read tank health after the rockets hit
+// -----------------------------------------------------------
+void Game::BuildUpdateGraph()
+{
+    using namespace tbb::flow;
+
+    update_graph = std::make_unique<graph>();
+    update_start = std::make_unique<broadcast_node<continue_msg>>(*update_graph);
 
-    //Remove exploded rockets with remove erase idiom
-    rockets.erase(
-        std::remove_if(rockets.begin(), rockets.end(), [](const Rocket& rocket) { return !rocket.active; }),
-        rockets.end());
+    auto node = [this](auto body) {
+        update_nodes.emplace_back(std::make_unique<continue_node<continue_msg>>(*update_graph, [body](const continue_msg&) { body(); }));
+        return update_nodes.back().get();
+    };
 
-    tbb::task_group update_Group;
-    //Update tanks
-    update_Group.run([&] { UpdateTanks(); });
-    update_Group.run([&] {
+    auto kd = node([this] {
+        if (frame_count % 200 != 0) return;
+        ScopedPhaseTimer kd(phase_timer, PHASE_BUILD_KD_TREE);
+        BuildKDTree();
+    });
+    auto beams = node([this] { UpdateParticleBeams(); });
+    auto smoke = node([this] { UpdateSmoke(); });
+    auto explosion = node([this] {
+        UpdateExplosions();
+
+        //Remove when done with remove erase idiom
+        explosions.erase(std::remove_if(explosions.begin(), explosions.end(),
+                                        [](const Explosion& eExplosion) { return eExplosion.done(); }),
+                         explosions.end());
+        first_explosion = explosions.size();
+    });
+    auto rocket = node([this] {
+        UpdateRockets();
+
+        //Remove exploded rockets with remove erase idiom
+        rockets.erase(
+            std::remove_if(rockets.begin(), rockets.end(), [](const Rocket& rocket) { return !rocket.active; }),
+            rockets.end());
+        first_rocket = rockets.size();
+    });
+    auto tank = node([this] { UpdateTanks(); });
+    auto red_hp = node([this] {
 #ifdef USING_EASY_PROFILER
         EASY_BLOCK("UpdateRedHP", profiler::colors::Red);
 #endif
+        TRACE_SCOPE("UpdateRedHP");
+        ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_RED_HP);
         //redHealthBars = LinkedList<int>::Sort(redTanks, 100);
-        redHealthBars = CountSort(redTanks);
+        redHealthBars = CountSort(redTanks, num_red_tanks);
     });
-    update_Group.run([&] {
+    auto blue_hp = node([this] {
 #ifdef USING_EASY_PROFILER
         EASY_BLOCK("UpdateBlueHP", profiler::colors::Blue);
 #endif
+        TRACE_SCOPE("UpdateBlueHP");
+        ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_BLUE_HP);
         //blueHealthBars = LinkedList<int>::Sort(blueTanks, 100);
-        blueHealthBars = CountSort(blueTanks);
+        blueHealthBars = CountSort(blueTanks, num_blue_tanks);
     });
-    update_Group.wait();
+
+    for (auto first : {kd, beams, smoke, explosion}) make_edge(*update_start, *first);
+    for (auto before : {kd, smoke, explosion}) make_edge(*before, *rocket);
+    for (auto after : {tank, red_hp, blue_hp}) make_edge(*rocket, *after);
+    make_edge(*kd, *tank);
+    make_edge(*beams, *tank);
 }
 
 void Game::BuildKDTree()
@@ -230,9 +361,20 @@ void Game::BuildKDTree()
 #ifdef USING_EASY_PROFILER
     EASY_BLOCK("BuildKDTree", profiler::colors::Black);
 #endif
+    delete red_KD_Tree;
+    delete blue_KD_Tree;
+
     tbb::task_group KD_sort_group;
-    KD_sort_group.run([&] { red_KD_Tree = new KD_Tree(redTanks); });
-    KD_sort_group.run([&] { blue_KD_Tree = new KD_Tree(blueTanks); });
+    KD_sort_group.run([&] {
+        TRACE_SCOPE("Build red KD tree");
+        CounterScope counters(PHASE_BUILD_KD_TREE);
+        red_KD_Tree = new KD_Tree(redTanks);
+    });
+    KD_sort_group.run([&] {
+        TRACE_SCOPE("Build blue KD tree");
+        CounterScope counters(PHASE_BUILD_KD_TREE);
+        blue_KD_Tree = new KD_Tree(blueTanks);
+    });
     KD_sort_group.wait();
 }
 
@@ -241,65 +383,388 @@ void Game::UpdateTanks()
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
-    tbb::parallel_for(tbb::blocked_range<int>(0, tanks.size()),
-                      [&](tbb::blocked_range<int> r) {
+    TRACE_SCOPE("UpdateTanks");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_TANKS);
+    if (!neighbours)
+    {
+        UpdateTanksByColumn();
+        return;
+    }
+
+    PartitionTanks();
+
+    //Check tank collision and nudge tanks away from each other, before any tank moves
+    {
+        TRACE_SCOPE("Separate Tanks");
+        neighbours->Separate(tanks, *grid);
+    }
+
+    if (deterministic)
+    {
+        UpdateTanksDeterministic();
+        return;
+    }
+
+    ParallelFor(tank_partition,
+                [&](tbb::blocked_range<int> r) {
 #if PROFILE_PARALLEL == 1
-                          EASY_BLOCK("Update Tank", profiler::colors::Gold);
+                    EASY_BLOCK("Update Tank", profiler::colors::Gold);
 #endif
+                    TRACE_SCOPE("Update Tank");
+                    CounterScope counters(PHASE_UPDATE_TANKS);
+                    for (int i = r.begin(); i < r.end(); ++i)
+                    {
+                        Tank& tank = tanks[i];
+                        if (!tank.active) continue;
+
+                        //Check if inside particle beam
+                        for (Particle_beam& particle_beam : particle_beams)
+                        {
+                            if (particle_beam.rectangle.intersectsCircle(tank.Get_Position(),
+                                                                         tank.Get_collision_radius()))
+                            {
+                                if (tank.hit(particle_beam.damage))
+                                {
+                                    smokes.emplace_back(smoke, tank.position - vec2<>(0, 48));
+                                }
+                            }
+                        }
+
+                        //Move tanks according to speed and nudges (see above) also reload
+                        tank.Tick(*grid);
+
+                        //Shoot at closest target if reloaded
+                        if (!tank.Rocket_Reloaded()) continue;
+                        Tank* target = tank.alliance == RED ? blue_KD_Tree->findClosestTank(&tank) : red_KD_Tree->findClosestTank(&tank);
+                        scoped_lock lock2(tankVectorMutex);
+                        rockets.emplace_back(tank.position,
+                                             (target->position - tank.position).normalized() * 3,
+                                             rocket_radius,
+                                             tank.alliance,
+                                             ((tank.alliance == RED) ? rocket_red : rocket_blue));
+                        tank.Reload_Rocket();
+                    }
+                });
+}
+
+void Game::PartitionTanks()
+{
+    //Separation has its own sweep, what is left costs about the same for every active tank and nothing for a dead one
+    tank_partition.Build(live_tanks, PartitionCount(), [&](size_t i) { return tanks[i].active ? 2 : 1; });
+}
+
+void Game::PartitionRockets()
+{
+    //Only the deterministic mode checks collisions in the rocket loop, otherwise moving a rocket costs the same for all
+    rocket_partition.Build(rockets.size(), PartitionCount(), [&](size_t i) {
+        return deterministic ? 1 + grid->NeighbourCount(Grid::GetGridCell(rockets[i].position)) : 1;
+    });
+}
+
+void Game::UpdateTanksDeterministic()
+{
+    tank_spawns.assign(tanks.size(), TankSpawns());
+
+    //Particle beams only change the tank itself, so no tank sees another one half moved
+    ParallelFor(tank_partition,
+                [&](tbb::blocked_range<int> r) {
+                    TRACE_SCOPE("Particle Beams");
+                    CounterScope counters(PHASE_UPDATE_TANKS);
+                    for (int i = r.begin(); i < r.end(); ++i)
+                    {
+                        Tank& tank = tanks[i];
+                        if (!tank.active) continue;
+
+                        TankSpawns& spawns = tank_spawns[i];
+                        spawns.updated = true;
+
+                        for (Particle_beam& particle_beam : particle_beams)
+                        {
+                            if (particle_beam.rectangle.intersectsCircle(tank.Get_Position(),
+                                                                         tank.Get_collision_radius()) &&
+                                tank.hit(particle_beam.damage))
+                            {
+                                spawns.smokes++;
+                                spawns.smoke_position = tank.position - vec2<>(0, 48);
+                            }
+                        }
+                    }
+                });
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, live_tanks),
+                      [&](tbb::blocked_range<int> r) {
+                          TRACE_SCOPE("Move Tank");
+                          CounterScope counters(PHASE_UPDATE_TANKS);
+                          for (int i = r.begin(); i < r.end(); ++i)
+                              if (tank_spawns[i].updated) tanks[i].Tick(*grid);
+                      });
+
+    AimTanksDeterministic();
+}
+
+// -----------------------------------------------------------
+// Separate, hit with beams and move the tanks column by column,
+// so every column is finished while its tanks are still in
+// cache instead of walking all tanks once per step
+// -----------------------------------------------------------
+void Game::UpdateTanksByColumn()
+{
+    column_moves.resize(GRID_SIZE + 1);
+    if (deterministic) tank_spawns.assign(tanks.size(), TankSpawns());
+
+    auto update = [&](int x) {
+        vector<Tank*>& moves = column_moves[x];
+        moves.clear();
+        for (int y = 0; y <= GRID_SIZE; ++y)
+        {
+            for (Tank* tank : grid->grid[x][y])
+            {
+                if (!tank->active) continue;
+
+                //Check if inside particle beam
+                int hits = 0;
+                for (Particle_beam& particle_beam : particle_beams)
+                {
+                    if (particle_beam.rectangle.intersectsCircle(tank->Get_Position(), tank->Get_collision_radius()) &&
+                        tank->hit(particle_beam.damage))
+                        hits++;
+                }
+                vec2<> smoke_position = tank->position - vec2<>(0, 48);
+
+                //Other sweeps still read the cells, so the tank changes cell once every column is done. A tank the
+                //beams destroyed leaves the grid below instead
+                if (tank->Move() && tank->active) moves.push_back(tank);
+
+                if (deterministic)
+                {
+                    TankSpawns& spawns = tank_spawns[tank - tanks.data()];
+                    spawns.updated = true;
+                    spawns.smokes = hits;
+                    spawns.smoke_position = smoke_position;
+                    continue;
+                }
+
+                //Shoot at closest target if reloaded
+                Tank* target = nullptr;
+                if (tank->Rocket_Reloaded())
+                    target = tank->alliance == RED ? blue_KD_Tree->findClosestTank(tank) : red_KD_Tree->findClosestTank(tank);
+                if (hits == 0 && target == nullptr) continue;
+
+                scoped_lock lock(tankVectorMutex);
+                for (int s = 0; s < hits; ++s) smokes.emplace_back(smoke, smoke_position);
+                if (target == nullptr) continue;
+                rockets.emplace_back(tank->position,
+                                     (target->position - tank->position).normalized() * 3,
+                                     rocket_radius,
+                                     tank->alliance,
+                                     ((tank->alliance == RED) ? rocket_red : rocket_blue));
+                tank->Reload_Rocket();
+            }
+        }
+
+        //The rockets and beams of this frame are done with the tanks of this column
+        grid->RemoveInactiveTanks(x);
+    };
+
+    //The even columns are swept first. The sweep of an odd column then gives the last pushes to the tanks of its own
+    //column and of the column after it, no other sweep reads those tanks any more, so they can be updated right away
+    tbb::parallel_for(
+        tbb::blocked_range<int>(0, (GRID_SIZE + 2) / 2, 1),
+        [&](tbb::blocked_range<int> r) {
+            TRACE_SCOPE("Separate Tanks");
+            CounterScope counters(PHASE_UPDATE_TANKS);
+            for (int i = r.begin(); i < r.end(); ++i) SeparateColumn(*grid, 2 * i);
+        },
+        tbb::simple_partitioner());
+    tbb::parallel_for(
+        tbb::blocked_range<int>(0, (GRID_SIZE + 2) / 2, 1),
+        [&](tbb::blocked_range<int> r) {
+            TRACE_SCOPE("Update Tank");
+            CounterScope counters(PHASE_UPDATE_TANKS);
+            for (int i = r.begin(); i < r.end(); ++i)
+            {
+                int x = 2 * i - 1;
+                if (x >= 0) SeparateColumn(*grid, x);
+                for (int column = std::max(x, 0); column <= std::min(x + 1, GRID_SIZE); ++column) update(column);
+            }
+        },
+        tbb::simple_partitioner());
+
+    for (const vector<Tank*>& moves : column_moves)
+    {
+        for (Tank* tank : moves)
+        {
+            vec2<int> cell = Grid::GetGridCell(tank->position);
+            grid->MoveTankToGridCell(tank, cell);
+            tank->gridCell = cell;
+        }
+    }
+
+    if (deterministic) AimTanksDeterministic();
+}
+
+void Game::AimTanksDeterministic()
+{
+    grid->SortCells();
+
+    //Aim once every tank has moved
+    tbb::parallel_for(tbb::blocked_range<int>(0, live_tanks),
+                      [&](tbb::blocked_range<int> r) {
+                          TRACE_SCOPE("Aim Tank");
+                          CounterScope counters(PHASE_UPDATE_TANKS);
                           for (int i = r.begin(); i < r.end(); ++i)
                           {
                               Tank& tank = tanks[i];
-                              if (!tank.active) continue;
-
-                              //Check tank collision and nudge tanks away from each other
-                              for (const auto& cell : Grid::GetNeighbouringCells())
-                              {
-                                  int x = tank.gridCell.x + cell.x;
-                                  int y = tank.gridCell.y + cell.y;
-                                  if (x < 0 || y < 0 || x > GRID_SIZE || y > GRID_SIZE) continue;
-
-                                  for (auto& oTank : Grid::Instance()->grid[x][y])
-                                  {
-                                      if (&tank == oTank) continue;
-
-                                      vec2<> dir = tank.Get_Position() - oTank->Get_Position();
-
-                                      float colSquaredLen =
-                                          (tank.Get_collision_radius() * tank.Get_collision_radius()) +
-                                          (oTank->Get_collision_radius() * oTank->Get_collision_radius());
-
-                                      if (dir.sqrLength() < colSquaredLen) tank.Push(dir.normalized(), 1.f);
-                                  }
-                              }
-
-                              //Check if inside particle beam
-                              for (Particle_beam& particle_beam : particle_beams)
-                              {
-                                  if (particle_beam.rectangle.intersectsCircle(tank.Get_Position(),
-                                                                               tank.Get_collision_radius()))
-                                  {
-                                      if (tank.hit(particle_beam.damage))
-                                      {
-                                          smokes.emplace_back(smoke, tank.position - vec2<>(0, 48));
-                                      }
-                                  }
-                              }
-
-                              //Move tanks according to speed and nudges (see above) also reload
-                              tank.Tick();
-
-                              //Shoot at closest target if reloaded
-                              if (!tank.Rocket_Reloaded()) continue;
-                              Tank* target = tank.alliance == RED ? blue_KD_Tree->findClosestTank(&tank) : red_KD_Tree->findClosestTank(&tank);
-                              scoped_lock lock2(tankVectorMutex);
-                              rockets.emplace_back(tank.position,
-                                                   (target->position - tank.position).normalized() * 3,
-                                                   rocket_radius,
-                                                   tank.alliance,
-                                                   ((tank.alliance == RED) ? rocket_red : rocket_blue));
-                              tank.Reload_Rocket();
+                              if (!tank_spawns[i].updated || !tank.Rocket_Reloaded()) continue;
+                              tank_spawns[i].target = tank.alliance == RED ? blue_KD_Tree->findClosestTank(&tank) : red_KD_Tree->findClosestTank(&tank);
                           }
                       });
+
+    //Spawn in id order, so sorting the tanks in memory does not change the rockets
+    for (uint32_t i : tank_slots)
+    {
+        if (i >= live_tanks) continue;
+
+        Tank& tank = tanks[i];
+        const TankSpawns& spawns = tank_spawns[i];
+        for (int s = 0; s < spawns.smokes; ++s) smokes.emplace_back(smoke, spawns.smoke_position);
+
+        if (spawns.target == nullptr) continue;
+        rockets.emplace_back(tank.position,
+                             (spawns.target->position - tank.position).normalized() * 3,
+                             rocket_radius,
+                             tank.alliance,
+                             ((tank.alliance == RED) ? rocket_red : rocket_blue),
+                             (int)CounterRandom(seed, tank.id, frame_count));
+        tank.Reload_Rocket();
+    }
+}
+
+// -----------------------------------------------------------
+// Reorder the tanks in memory by the Morton code of their cell,
+// the tank lists, grid cells and KD trees point at the tanks
+// so they are moved along
+// -----------------------------------------------------------
+void Game::SortTanks()
+{
+#ifdef USING_EASY_PROFILER
+    EASY_FUNCTION(profiler::colors::Yellow);
+#endif
+    TRACE_SCOPE("SortTanks");
+    ScopedPhaseTimer t(phase_timer, PHASE_SORT_TANKS);
+    if (tanks.empty()) return;
+
+    //Every live tank is in one cell, so walking the cells lists them once without sorting. The deterministic mode keeps
+    //the tanks of a cell in id order, which makes the new order the same for any thread count
+    sort_order.clear();
+    for (const vec2<int>& cell : Grid::CellsInMortonOrder())
+        for (const Tank* tank : grid->grid[cell.x][cell.y])
+            if (tank->active) sort_order.push_back((uint32_t)(tank - tanks.data()));
+    size_t live = sort_order.size();
+
+    //The wrecks go behind them in the order they are in
+    for (size_t i = 0; i < tanks.size(); ++i)
+        if (!tanks[i].active) sort_order.push_back((uint32_t)i);
+    if (sort_order.size() != tanks.size()) return;
+
+    live_tanks = live;
+    ReorderTanks();
+}
+
+// -----------------------------------------------------------
+// Drop the tanks destroyed last frame from the tank lists and
+// move the wrecks behind the live tanks once enough of them
+// are in between
+// -----------------------------------------------------------
+void Game::RemoveDestroyedTanks()
+{
+    for (vector<Tank*>* army : {&redTanks, &blueTanks})
+        army->erase(remove_if(army->begin(), army->end(), [](const Tank* tank) { return !tank->active; }), army->end());
+
+    //The lists hold exactly the live tanks now
+    size_t wrecks = live_tanks - min(live_tanks, redTanks.size() + blueTanks.size());
+    if (wrecks > 0 && wrecks >= live_tanks / 4) CompactTanks();
+}
+
+void Game::CompactTanks()
+{
+#ifdef USING_EASY_PROFILER
+    EASY_FUNCTION(profiler::colors::Yellow);
+#endif
+    TRACE_SCOPE("CompactTanks");
+    ScopedPhaseTimer t(phase_timer, PHASE_COMPACT_TANKS);
+
+    //The update takes the wrecks out of the grid as it goes, the neighbour lists leave them in until here
+    grid->RemoveInactiveTanks();
+
+    //The live tanks and the wrecks both keep their order, so a sorted order stays sorted
+    sort_order.clear();
+    for (size_t i = 0; i < live_tanks; ++i)
+        if (tanks[i].active) sort_order.push_back((uint32_t)i);
+    size_t live = sort_order.size();
+    for (size_t i = 0; i < live_tanks; ++i)
+        if (!tanks[i].active) sort_order.push_back((uint32_t)i);
+    for (size_t i = live_tanks; i < tanks.size(); ++i) sort_order.push_back((uint32_t)i);
+
+    live_tanks = live;
+    ReorderTanks();
+}
+
+// -----------------------------------------------------------
+// Move every tank to its place in sort_order
+// -----------------------------------------------------------
+void Game::ReorderTanks()
+{
+    CostPartition sort;
+    sort.SetStatic(numa);
+    sort.Build(tanks.size(), PartitionCount(), [](size_t) { return 1; });
+
+    //Allocated on the first sort and first touched like the tanks in Init, after that the two buffers take turns
+    if (sorted_tanks.size() != tanks.size())
+    {
+        sorted_tanks = vector<Tank>();
+        sorted_tanks.reserve(tanks.size());
+        FirstTouch(sorted_tanks.data(), sizeof(Tank), sort);
+        sorted_tanks.resize(tanks.size(), tanks.front());
+    }
+
+    sort_slots.resize(tanks.size());
+    ParallelFor(sort, [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i)
+        {
+            sorted_tanks[i] = tanks[sort_order[i]];
+            sort_slots[sort_order[i]] = i;
+        }
+    });
+
+    auto moved = [&](Tank* tank) { return tank ? &sorted_tanks[sort_slots[tank - tanks.data()]] : nullptr; };
+
+    //The tank lists keep their order, so the KD trees built from them stay the same
+    for (vector<Tank*>* army : {&redTanks, &blueTanks})
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, army->size()), [&](tbb::blocked_range<size_t> r) {
+            for (size_t i = r.begin(); i < r.end(); ++i) (*army)[i] = moved((*army)[i]);
+        });
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, GRID_SIZE + 1), [&](tbb::blocked_range<int> r) {
+        for (int x = r.begin(); x < r.end(); ++x)
+            for (auto& cell : grid->grid[x])
+                for (Tank*& tank : cell) tank = moved(tank);
+    });
+
+    for (KD_Tree** tree : {&red_KD_Tree, &blue_KD_Tree})
+    {
+        if (*tree == nullptr) continue;
+        vector<Tank*> nodes = (*tree)->nodes();
+        for (Tank*& tank : nodes) tank = moved(tank);
+        delete *tree;
+        *tree = KD_Tree::fromNodes(nodes);
+    }
+
+    tanks.swap(sorted_tanks);
+    if (neighbours) neighbours->Remap(sort_slots);
+    ParallelFor(sort, [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) tank_slots[tanks[i].id] = i;
+    });
 }
 
 void Game::UpdateSmoke()
@@ -307,6 +772,8 @@ void Game::UpdateSmoke()
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
+    TRACE_SCOPE("UpdateSmoke");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_SMOKE);
     for (Smoke& uSmoke : smokes)
     {
         uSmoke.Tick();
@@ -318,60 +785,153 @@ void Game::UpdateRockets()
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
-    tbb::parallel_for(tbb::blocked_range<int>(0, rockets.size()),
-                      [&](tbb::blocked_range<int> r) {
+    TRACE_SCOPE("UpdateRockets");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_ROCKETS);
+    PartitionRockets();
+    if (deterministic)
+    {
+        UpdateRocketsDeterministic();
+        return;
+    }
+
+    ParallelFor(rocket_partition,
+                [&](tbb::blocked_range<int> r) {
 #if PROFILE_PARALLEL == 1
-                          EASY_BLOCK("Update Rocket", profiler::colors::Gold);
+                    EASY_BLOCK("Update Rocket", profiler::colors::Gold);
 #endif
-                          for (int i = r.begin(); i < r.end(); ++i)
-                          {
-                              Rocket& uRocket = rockets[i];
-                              uRocket.Tick();
-
-                              if (uRocket.position.x < -250 || uRocket.position.y < -250 || uRocket.position.x > 1750 || uRocket.position.y > 1750)
-                              {
-                                  uRocket.active = false;
-                                  continue;
-                              }
-
-                              //Check if rocket collides with enemy tank, spawn explosion and if tank is destroyed spawn a smoke plume
-                              for (const auto& cell : Grid::GetNeighbouringCells())
-                              {
-                                  vec2<int> rocketGridCell = Grid::GetGridCell(uRocket.position);
-                                  int x = rocketGridCell.x + cell.x;
-                                  int y = rocketGridCell.y + cell.y;
-                                  if (x < 0 || y < 0 || x > GRID_SIZE || y > GRID_SIZE) continue;
-
-                                  for (auto& tank : Grid::Instance()->grid[x][y])
-                                  {
-                                      if (tank->active && (tank->alliance != uRocket.allignment) &&
-                                          uRocket.Intersects(tank->position, tank->collision_radius))
-                                      {
-                                          scoped_lock lock(tankVectorMutex);
-                                          explosions.emplace_back(explosion, tank->position);
-
-                                          if (tank->hit(ROCKET_HIT_VALUE))
-                                          {
-                                              smokes.emplace_back(smoke, tank->position - vec2<>(0, 48));
-                                          }
-
-                                          uRocket.active = false;
-                                          break;
-                                      }
-                                  }
-                              }
-                          }
-                      });
+                    TRACE_SCOPE("Update Rocket");
+                    CounterScope counters(PHASE_UPDATE_ROCKETS);
+                    for (int i = r.begin(); i < r.end(); ++i)
+                    {
+                        Rocket& uRocket = rockets[i];
+                        uRocket.Tick();
+
+                        if (uRocket.position.x < -250 || uRocket.position.y < -250 || uRocket.position.x > 1750 || uRocket.position.y > 1750)
+                        {
+                            uRocket.active = false;
+                        }
+                    }
+                });
+
+    //Check if rockets collide with enemy tanks, spawn explosions and if a tank is destroyed spawn a smoke plume
+    CollideRocketsByCell();
 #ifdef USING_EASY_PROFILER
     //MICROPROFILE_COUNTER_SET("Game/rockets/", rockets.size());
 #endif
 }
 
+void Game::CollideRocketsByCell()
+{
+    grid->BinRockets(rockets);
+
+    //A column costs a check for every tank against every rocket around it
+    column_partition.Build(GRID_SIZE + 1, PartitionCount(), [&](size_t x) {
+        size_t checks = 1;
+        for (int y = 0; y < GRID_SIZE + 1; ++y)
+            if (!grid->grid[x][y].empty()) checks += grid->grid[x][y].size() * grid->RocketNeighbourCount(vec2<int>((int)x, y));
+        return checks;
+    });
+    column_hits.resize(GRID_SIZE + 1);
+
+    //One task per range of columns checks the tanks of its cells against the rockets around them, so only that task
+    //changes the health of those tanks and nothing has to be locked. Like CollideRocket a rocket hits at most one tank
+    //per cell
+    const vector<vec2<int>> neighbours = Grid::GetNeighbouringCells();
+    ParallelFor(column_partition,
+                [&](tbb::blocked_range<int> r) {
+                    TRACE_SCOPE("Collide Rockets");
+                    CounterScope counters(PHASE_UPDATE_ROCKETS);
+                    for (int x = r.begin(); x < r.end(); ++x)
+                    {
+                        ColumnHits& hits = column_hits[x];
+                        hits.rockets.clear();
+                        hits.explosions.clear();
+                        hits.smokes.clear();
+
+                        for (int y = 0; y < GRID_SIZE + 1; ++y)
+                        {
+                            const vector<Tank*>& cell = grid->grid[x][y];
+                            if (cell.empty()) continue;
+
+                            for (const vec2<int>& offset : neighbours)
+                            {
+                                int rocket_x = x - offset.x;
+                                int rocket_y = y - offset.y;
+                                if (rocket_x < 0 || rocket_y < 0 || rocket_x > GRID_SIZE || rocket_y > GRID_SIZE) continue;
+
+                                for (uint32_t index : grid->rocket_grid[rocket_x][rocket_y])
+                                {
+                                    const Rocket& rocket = rockets[index];
+                                    for (Tank* tank : cell)
+                                    {
+                                        if (!tank->active || tank->alliance == rocket.allignment ||
+                                            !rocket.Intersects(tank->position, tank->collision_radius)) continue;
+
+                                        hits.rockets.push_back(index);
+                                        hits.explosions.push_back(tank->position);
+                                        if (tank->hit(parameters.rocket_hit_value)) hits.smokes.push_back(tank->position - vec2<>(0, 48));
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                });
+
+    for (const ColumnHits& hits : column_hits)
+    {
+        for (uint32_t index : hits.rockets) rockets[index].active = false;
+        for (const vec2<>& position : hits.explosions) explosions.emplace_back(explosion, position);
+        for (const vec2<>& position : hits.smokes) smokes.emplace_back(smoke, position);
+    }
+}
+
+void Game::UpdateRocketsDeterministic()
+{
+    rocket_hits.assign(rockets.size(), RocketHits());
+
+    //Only collect the hits, tanks are not changed until every rocket has been checked
+    ParallelFor(rocket_partition,
+                [&](tbb::blocked_range<int> r) {
+                    TRACE_SCOPE("Update Rocket");
+                    CounterScope counters(PHASE_UPDATE_ROCKETS);
+                    for (int i = r.begin(); i < r.end(); ++i)
+                    {
+                        Rocket& uRocket = rockets[i];
+                        uRocket.Tick();
+
+                        if (uRocket.position.x < -250 || uRocket.position.y < -250 || uRocket.position.x > 1750 || uRocket.position.y > 1750)
+                        {
+                            uRocket.active = false;
+                            continue;
+                        }
+
+                        RocketHits& hits = rocket_hits[i];
+                        CollideRocket(uRocket, *grid, [&](Tank* tank) { hits.tanks[hits.count++] = tank; });
+                    }
+                });
+
+    //A tank destroyed by an earlier rocket this frame absorbs the later ones without another explosion
+    for (const RocketHits& hits : rocket_hits)
+    {
+        for (int h = 0; h < hits.count; ++h)
+        {
+            Tank* tank = hits.tanks[h];
+            if (!tank->active) continue;
+
+            explosions.emplace_back(explosion, tank->position);
+            if (tank->hit(parameters.rocket_hit_value)) smokes.emplace_back(smoke, tank->position - vec2<>(0, 48));
+        }
+    }
+}
+
 void Game::UpdateParticleBeams()
 {
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
+    TRACE_SCOPE("UpdateParticleBeams");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_PARTICLE_BEAMS);
     for (Particle_beam& particle_beam : particle_beams)
     {
         particle_beam.tick();
@@ -383,6 +943,8 @@ void Game::UpdateExplosions()
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
+    TRACE_SCOPE("UpdateExplosions");
+    ScopedPhaseTimer t(phase_timer, PHASE_UPDATE_EXPLOSIONS);
     for (Explosion& uExplosion : explosions)
     {
         uExplosion.Tick();
@@ -394,6 +956,8 @@ void Game::Draw()
 #ifdef USING_EASY_PROFILER
     EASY_FUNCTION(profiler::colors::Yellow);
 #endif
+    TRACE_SCOPE("Draw");
+    ScopedPhaseTimer t(phase_timer, PHASE_DRAW);
 
     //Draw background
     //SDL_RenderCopy(screen, background, NULL, NULL);
@@ -514,8 +1078,389 @@ void PP2::Game::MeasurePerformance()
         SDL_RenderFillRect(screen, &r);
 
         int ms = (int)duration % 1000, sec = ((int)duration / 1000) % 60, min = ((int)duration / 60000);
-        FC_Draw(GameFont, screen, 470, 220, " %02i:%02i:%03i \n SPEEDUP: %4.1f", min, sec, ms, REF_PERFORMANCE / duration);
+        FC_Draw(font, screen, 470, 220, " %02i:%02i:%03i \n SPEEDUP: %4.1f", min, sec, ms, REF_PERFORMANCE / duration);
+    }
+}
+
+void Game::KeyDown(int key)
+{
+    //Print the frame time percentiles on request
+    if (key == SDL_SCANCODE_P) phase_timer.Print(cout);
+
+    //Save the battle so a later run can start from here with --checkpoint
+    if (key == SDL_SCANCODE_C && SaveCheckpoint("checkpoint.pp2c")) cout << "Saved checkpoint.pp2c at frame " << frame_count << endl;
+}
+
+void Game::StartRecording(const std::string& path, int keyframe_interval)
+{
+    recorder = std::make_unique<ReplayRecorder>(path, tanks, tank_slots, keyframe_interval);
+    if (!recorder->IsOpen()) recorder.reset();
+}
+
+size_t Game::ActiveTanks(alliances alliance) const
+{
+    const vector<Tank*>& army = alliance == RED ? redTanks : blueTanks;
+    return std::count_if(army.begin(), army.end(), [](const Tank* tank) { return tank->active; });
+}
+
+uint64_t Game::HashState() const
+{
+    StateHash hash;
+    for (uint32_t i : tank_slots) hash.Add(tanks[i]);
+
+    //Rockets that exploded this frame are already removed
+    hash.Add((uint32_t)rockets.size());
+    for (const Rocket& rocket : rockets) hash.Add(rocket);
+    return hash.Value();
+}
+
+void Game::StartHashing(const std::string& path, int interval)
+{
+    hash_log = std::make_unique<StateHashLog>(path, interval);
+    if (!hash_log->IsOpen()) hash_log.reset();
+}
+
+bool Game::SaveCheckpoint(const std::string& path) const
+{
+    CheckpointWriter out;
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = checkpoint_version;
+    header.frame_count = frame_count;
+    header.tank_count = (uint32_t)tanks.size();
+    header.rocket_count = (uint32_t)rockets.size();
+    header.smoke_count = (uint32_t)smokes.size();
+    header.explosion_count = (uint32_t)explosions.size();
+    header.particle_beam_count = (uint32_t)particle_beams.size();
+    header.red_count = (uint32_t)redTanks.size();
+    header.blue_count = (uint32_t)blueTanks.size();
+    out.Write(header);
+
+    for (const Tank& tank : tanks)
+    {
+        out.Write(tank.id);
+        out.Write(tank.position);
+        out.Write(tank.gridCell);
+        out.Write(tank.speed);
+        out.Write(tank.target);
+        out.Write(tank.health);
+        out.Write(tank.collision_radius);
+        out.Write(tank.force);
+        out.Write(tank.max_speed);
+        out.Write(tank.reload_time);
+        out.Write(tank.reloaded);
+        out.Write(tank.active);
+        out.Write(tank.alliance);
+        out.Write(tank.current_frame);
+        out.Write(tank.SrcR);
+        out.Write(tank.DestR);
+    }
+    for (const Rocket& rocket : rockets)
+    {
+        out.Write(rocket.position);
+        out.Write(rocket.speed);
+        out.Write(rocket.id);
+        out.Write(rocket.collision_radius);
+        out.Write(rocket.active);
+        out.Write(rocket.allignment);
+        out.Write(rocket.current_frame);
+        out.Write(rocket.SrcR);
+        out.Write(rocket.DestR);
+    }
+    for (const Smoke& s : smokes)
+    {
+        out.Write(s.position);
+        out.Write(s.current_frame);
+        out.Write(s.SrcR);
+        out.Write(s.DestR);
+    }
+    for (const Explosion& e : explosions)
+    {
+        out.Write(e.position);
+        out.Write(e.current_frame);
+        out.Write(e.SrcR);
+        out.Write(e.DestR);
+    }
+    for (const Particle_beam& beam : particle_beams)
+    {
+        out.Write(beam.min_position);
+        out.Write(beam.max_position);
+        out.Write(beam.rectangle);
+        out.Write(beam.sprite_frame);
+        out.Write(beam.damage);
+        out.Write(beam.SrcR);
+        out.Write(beam.DestR);
+    }
+
+    //Tanks are stored by index, a null tank (empty KD branch) as -1
+    auto index = [this](const Tank* tank) { return tank ? (int32_t)(tank - tanks.data()) : -1; };
+
+    for (const Tank* tank : redTanks) out.Write(index(tank));
+    for (const Tank* tank : blueTanks) out.Write(index(tank));
+
+    //The order of the tanks in a cell decides the order they are pushed apart, so keep it
+    for (auto& column : grid->grid)
+        for (auto& cell : column)
+        {
+            out.Write((uint32_t)cell.size());
+            for (const Tank* tank : cell) out.Write(index(tank));
+        }
+
+    for (KD_Tree* tree : {red_KD_Tree, blue_KD_Tree})
+    {
+        vector<Tank*> nodes = tree ? tree->nodes() : vector<Tank*>();
+        out.Write((uint32_t)nodes.size());
+        for (const Tank* tank : nodes) out.Write(index(tank));
+    }
+
+    out.Write((uint8_t)(neighbours != nullptr));
+    if (neighbours) neighbours->Save(out);
+
+    return out.Save(path);
+}
+
+bool Game::LoadCheckpoint(const std::string& path)
+{
+    CheckpointReader in;
+    if (!in.Load(path)) return false;
+
+    auto header = in.Read<CheckpointHeader>();
+    if (!in.Ok() || memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 || header.version != checkpoint_version)
+    {
+        cout << "Not a checkpoint file " << path << endl;
+        return false;
+    }
+
+    //Bytes every record takes in the file, no count is used to size anything before the bytes left can hold it
+    constexpr size_t tank_bytes = sizeof(Tank::id) + sizeof(Tank::position) + sizeof(Tank::gridCell) + sizeof(Tank::speed) +
+                                  sizeof(Tank::target) + sizeof(Tank::health) + sizeof(Tank::collision_radius) +
+                                  sizeof(Tank::force) + sizeof(Tank::max_speed) + sizeof(Tank::reload_time) +
+                                  sizeof(Tank::reloaded) + sizeof(Tank::active) + sizeof(Tank::alliance) +
+                                  sizeof(Tank::current_frame) + sizeof(Tank::SrcR) + sizeof(Tank::DestR);
+    constexpr size_t rocket_bytes = sizeof(Rocket::position) + sizeof(Rocket::speed) + sizeof(Rocket::id) +
+                                    sizeof(Rocket::collision_radius) + sizeof(Rocket::active) + sizeof(Rocket::allignment) +
+                                    sizeof(Rocket::current_frame) + sizeof(Rocket::SrcR) + sizeof(Rocket::DestR);
+    constexpr size_t smoke_bytes = sizeof(Smoke::position) + sizeof(Smoke::current_frame) + sizeof(Smoke::SrcR) + sizeof(Smoke::DestR);
+    constexpr size_t explosion_bytes =
+        sizeof(Explosion::position) + sizeof(Explosion::current_frame) + sizeof(Explosion::SrcR) + sizeof(Explosion::DestR);
+    constexpr size_t beam_bytes = sizeof(Particle_beam::min_position) + sizeof(Particle_beam::max_position) +
+                                  sizeof(Particle_beam::rectangle) + sizeof(Particle_beam::sprite_frame) +
+                                  sizeof(Particle_beam::damage) + sizeof(Particle_beam::SrcR) + sizeof(Particle_beam::DestR);
+    auto truncated = [&] {
+        cout << "Checkpoint file " << path << " is truncated" << endl;
+        return false;
+    };
+
+    //Read everything before touching the game, so a truncated file leaves it as it was
+    if (!in.Fits(header.tank_count, tank_bytes)) return truncated();
+    vector<Tank> new_tanks;
+    vector<uint32_t> new_slots(header.tank_count, UINT32_MAX);
+    new_tanks.reserve(header.tank_count);
+    for (uint32_t i = 0; i < header.tank_count; ++i)
+    {
+        Tank tank(0, 0, BLUE, nullptr, smoke, 0, 0, 0, 0, 0);
+        in.Read(tank.id);
+        if (tank.id < header.tank_count && new_slots[tank.id] == UINT32_MAX) new_slots[tank.id] = i;
+        in.Read(tank.position);
+        in.Read(tank.gridCell);
+        in.Read(tank.speed);
+        in.Read(tank.target);
+        in.Read(tank.health);
+        in.Read(tank.collision_radius);
+        in.Read(tank.force);
+        in.Read(tank.max_speed);
+        in.Read(tank.reload_time);
+        in.Read(tank.reloaded);
+        in.Read(tank.active);
+        in.Read(tank.alliance);
+        in.Read(tank.current_frame);
+        in.Read(tank.SrcR);
+        in.Read(tank.DestR);
+        tank.tank_sprite = tank.alliance == RED ? tank_red : tank_blue;
+        new_tanks.emplace_back(tank);
+    }
+
+    if (!in.Fits(header.rocket_count, rocket_bytes)) return truncated();
+    vector<Rocket> new_rockets;
+    new_rockets.reserve(header.rocket_count);
+    for (uint32_t i = 0; i < header.rocket_count; ++i)
+    {
+        Rocket rocket(vec2<>(), vec2<>(), 0, BLUE, nullptr);
+        in.Read(rocket.position);
+        in.Read(rocket.speed);
+        in.Read(rocket.id);
+        in.Read(rocket.collision_radius);
+        in.Read(rocket.active);
+        in.Read(rocket.allignment);
+        in.Read(rocket.current_frame);
+        in.Read(rocket.SrcR);
+        in.Read(rocket.DestR);
+        rocket.rocket_sprite = rocket.allignment == RED ? rocket_red : rocket_blue;
+        new_rockets.emplace_back(rocket);
+    }
+
+    if (!in.Fits(header.smoke_count, smoke_bytes)) return truncated();
+    vector<Smoke> new_smokes;
+    new_smokes.reserve(header.smoke_count);
+    for (uint32_t i = 0; i < header.smoke_count; ++i)
+    {
+        Smoke s(smoke, vec2<>());
+        in.Read(s.position);
+        in.Read(s.current_frame);
+        in.Read(s.SrcR);
+        in.Read(s.DestR);
+        new_smokes.emplace_back(s);
+    }
+
+    if (!in.Fits(header.explosion_count, explosion_bytes)) return truncated();
+    vector<Explosion> new_explosions;
+    new_explosions.reserve(header.explosion_count);
+    for (uint32_t i = 0; i < header.explosion_count; ++i)
+    {
+        Explosion e(explosion, vec2<>());
+        in.Read(e.position);
+        in.Read(e.current_frame);
+        in.Read(e.SrcR);
+        in.Read(e.DestR);
+        new_explosions.emplace_back(e);
+    }
+
+    if (!in.Fits(header.particle_beam_count, beam_bytes)) return truncated();
+    vector<Particle_beam> new_particle_beams(header.particle_beam_count);
+    for (Particle_beam& beam : new_particle_beams)
+    {
+        in.Read(beam.min_position);
+        in.Read(beam.max_position);
+        in.Read(beam.rectangle);
+        in.Read(beam.sprite_frame);
+        in.Read(beam.damage);
+        in.Read(beam.SrcR);
+        in.Read(beam.DestR);
+        beam.particle_beam_sprite = particle_beam_sprite;
+    }
+
+    auto tank = [&](Tank* base) -> Tank* {
+        auto i = in.Read<int32_t>();
+        if (i < -1 || i >= (int32_t)header.tank_count) i = -1;
+        return i == -1 ? nullptr : base + i;
+    };
+
+    //Every list of tanks holds a tank at most once
+    auto fits_tanks = [&](size_t count) { return count <= header.tank_count && in.Fits(count, sizeof(int32_t)); };
+
+    //Pointers are resolved against the new tanks, whose storage does not move from here on
+    if (!fits_tanks(header.red_count) || !fits_tanks(header.blue_count) || !fits_tanks((size_t)header.red_count + header.blue_count))
+        return truncated();
+    vector<Tank*> new_red(header.red_count), new_blue(header.blue_count);
+    for (Tank*& t : new_red) t = tank(new_tanks.data());
+    for (Tank*& t : new_blue) t = tank(new_tanks.data());
+
+    vector<vector<Tank*>> cells;
+    for (int i = 0; i < (GRID_SIZE + 1) * (GRID_SIZE + 1) && in.Ok(); ++i)
+    {
+        auto count = in.Read<uint32_t>();
+        if (!fits_tanks(count)) return truncated();
+        cells.emplace_back(count);
+        for (Tank*& t : cells.back()) t = tank(new_tanks.data());
     }
+
+    //A KD tree of k tanks is saved as k nodes and k + 1 empty branches. Trees are only rebuilt every few frames, so
+    //they can still hold tanks that were destroyed and taken out of the army lists since, bound them by every tank
+    //of the alliance instead
+    vector<Tank*> kd_nodes[2];
+    size_t kd_tanks[2] = {0, 0};
+    for (const Tank& t : new_tanks)
+        if (t.alliance == RED || t.alliance == BLUE) ++kd_tanks[t.alliance == RED ? 0 : 1];
+    for (int a = 0; a < 2; ++a)
+    {
+        vector<Tank*>& nodes = kd_nodes[a];
+        auto count = in.Read<uint32_t>();
+        if (count > 2 * kd_tanks[a] + 1 || !in.Fits(count, sizeof(int32_t))) return truncated();
+        nodes.resize(count);
+        for (Tank*& t : nodes) t = tank(new_tanks.data());
+    }
+
+    //Lists saved by a game that used them, a game that does not skips them
+    NeighbourList new_neighbours(neighbours ? neighbours->Skin() : 0.f);
+    bool has_neighbours = in.Read<uint8_t>() != 0;
+    if (has_neighbours && !new_neighbours.Load(in, header.tank_count) && in.Ok())
+    {
+        cout << "Checkpoint file " << path << " has invalid neighbour lists" << endl;
+        return false;
+    }
+
+    if (!in.Ok()) return truncated();
+
+    if (std::count(new_slots.begin(), new_slots.end(), UINT32_MAX) != 0)
+    {
+        cout << "Checkpoint file " << path << " has invalid tank ids" << endl;
+        return false;
+    }
+
+    //Only the KD trees have empty entries, every tank is used as an index into the grid and the health bars
+    auto has_null = [](const vector<Tank*>& list) { return std::count(list.begin(), list.end(), nullptr) != 0; };
+    bool valid = !has_null(new_red) && !has_null(new_blue);
+    for (const vector<Tank*>& cell : cells) valid = valid && !has_null(cell);
+    for (const Tank& t : new_tanks)
+        valid = valid && (t.alliance == BLUE || t.alliance == RED) && t.health <= TANK_MAX_HEALTH && t.gridCell.x >= 0 &&
+                t.gridCell.y >= 0 && t.gridCell.x <= GRID_SIZE && t.gridCell.y <= GRID_SIZE;
+    if (!valid)
+    {
+        cout << "Checkpoint file " << path << " has invalid tanks" << endl;
+        return false;
+    }
+
+    KD_Tree* new_trees[2] = {nullptr, nullptr};
+    for (int a = 0; a < 2; ++a)
+        if (!kd_nodes[a].empty()) new_trees[a] = KD_Tree::fromNodes(kd_nodes[a]);
+    if ((!kd_nodes[0].empty() && !new_trees[0]) || (!kd_nodes[1].empty() && !new_trees[1]))
+    {
+        delete new_trees[0];
+        delete new_trees[1];
+        cout << "Checkpoint file " << path << " has invalid KD trees" << endl;
+        return false;
+    }
+
+    frame_count = header.frame_count;
+    tanks = move(new_tanks);
+    tank_slots = move(new_slots);
+    live_tanks = 0;
+    num_red_tanks = 0;
+    for (size_t i = 0; i < tanks.size(); ++i)
+    {
+        if (tanks[i].active) live_tanks = i + 1;
+        if (tanks[i].alliance == RED) num_red_tanks++;
+    }
+    num_blue_tanks = tanks.size() - num_red_tanks;
+    if (neighbours && has_neighbours)
+        *neighbours = move(new_neighbours);
+    else if (neighbours)
+        neighbours->Invalidate();
+    rockets = move(new_rockets);
+    smokes = move(new_smokes);
+    explosions = move(new_explosions);
+    particle_beams = move(new_particle_beams);
+    redTanks = move(new_red);
+    blueTanks = move(new_blue);
+
+    for (int x = 0; x < GRID_SIZE + 1; ++x)
+        for (int y = 0; y < GRID_SIZE + 1; ++y) grid->grid[x][y] = move(cells[x * (GRID_SIZE + 1) + y]);
+
+    delete red_KD_Tree;
+    delete blue_KD_Tree;
+    red_KD_Tree = new_trees[0];
+    blue_KD_Tree = new_trees[1];
+
+    redHealthBars = CountSort(redTanks, num_red_tanks);
+    blueHealthBars = CountSort(blueTanks, num_blue_tanks);
+    return true;
+}
+
+void Game::Step()
+{
+    Update(0);
+    frame_count++;
 }
 
 // -----------------------------------------------------------
@@ -537,6 +1482,6 @@ void Game::Tick(float deltaTime)
     {
         //Print frame count
         frame_count++;
-        FC_Draw(GameFont, screen, 5, 5, "%lld", frame_count);
+        FC_Draw(font, screen, 5, 5, "%lld", frame_count);
     }
 }
@@ -1,7 +1,14 @@
 #pragma once
 
+#include "Affinity.h"
 #include "Algorithms.h"
+#include "Formation.h"
 #include "Grid.h"
+#include "NeighbourList.h"
+#include "Partition.h"
+#include "PhaseTimer.h"
+#include "Replay.h"
+#include "StateHash.h"
 #include "defines.h"
 #include "explosion.h"
 #include "particle_beam.h"
@@ -10,20 +17,129 @@
 #include "tank.h"
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <tbb/flow_graph.h>
+#include <vector>
+
+typedef struct FC_Font FC_Font;
 
 namespace PP2
 {
+/**
+ * The unit constants a battle is played with, the defaults are the ones from defines.h
+ */
+struct BattleParameters
+{
+    int rocket_hit_value = ROCKET_HIT_VALUE;
+    float tank_max_speed = TANK_MAX_SPEED;
+};
+
 class Game
 {
   public:
+    ~Game();
+
     void SetTarget(SDL_Renderer* surface) { screen = surface; }
 
-    void Init();
+    /**
+     * Spawn the armies, without a target the game runs headless and loads no sprites
+     */
+    void Init(int num_blue = NUM_TANKS_BLUE, int num_red = NUM_TANKS_RED);
 
     void Shutdown();
 
     void Update(float deltaTime);
 
+    /**
+     * Advance the simulation one frame without drawing
+     */
+    void Step();
+
+    /**
+     * Append every following frame to a replay file, call after Init
+     * @param keyframe_interval Compress the replay with a keyframe every this many frames, 0 does not compress
+     */
+    void StartRecording(const std::string& path, int keyframe_interval = 0);
+
+    /**
+     * Convert the sprite BMPs to an asset pack, which LoadSprites then reads instead of the BMPs
+     */
+    static bool BuildAssetPack(const std::string& path);
+
+    /**
+     * Write the complete simulation state to a file, to be restored with LoadCheckpoint
+     */
+    bool SaveCheckpoint(const std::string& path) const;
+
+    /**
+     * Replace the simulation state with a checkpoint, the grid and KD trees are rebuilt exactly as they were saved
+     * Call after Init and before StartRecording
+     * @return False when the file could not be read, the game is left as it was
+     */
+    bool LoadCheckpoint(const std::string& path);
+
+    /**
+     * Give identical results for any thread count: spawns are applied in tank and rocket index order
+     * instead of the order threads get the lock, and rocket ids come from a counter based generator
+     */
+    void SetDeterministic(bool enabled, uint64_t seed = 0)
+    {
+        deterministic = enabled;
+        this->seed = seed;
+    }
+
+    /**
+     * Pin the TBB threads and, with numa, place the tanks, rockets and grid cells on the node of the threads that
+     * update them: the memory is first touched in parallel and the loops hand every thread the same ranges each frame
+     * Call before Init
+     */
+    void SetPlacement(Pinning pinning, bool numa);
+
+    /**
+     * Reorder the tanks in memory every interval frames by the Morton code of their grid cell, so tanks that are close
+     * on the field are close in memory and the tank loops find the tanks of the cells around them in cache
+     * Hashes, replays and the deterministic mode go by tank id, so they are the same with or without it. 0 turns it off
+     */
+    void SetSortInterval(int interval) { sort_interval = interval; }
+
+    /**
+     * Separate the tanks from Verlet lists with this skin in pixels, built again only once a tank moved more than half
+     * the skin, instead of sweeping the grid every frame. 0 sweeps the grid. Call before Init
+     * The strip runner always sweeps the grid, so it only matches a game that does too
+     */
+    void SetNeighbourSkin(float skin) { neighbour_skin = skin; }
+
+    /**
+     * Spawn the armies in other formations than the default blocks, call before Init
+     * An empty formation keeps the block of that army
+     */
+    void SetFormations(Formation blue, Formation red)
+    {
+        blue_formation = std::move(blue);
+        red_formation = std::move(red);
+    }
+
+    /**
+     * Play with other unit constants than the defaults, call before Init
+     */
+    void SetParameters(const BattleParameters& parameters) { this->parameters = parameters; }
+
+    /**
+     * Number of tanks of an alliance that are still alive
+     */
+    size_t ActiveTanks(alliances alliance) const;
+
+    /**
+     * Hash of the tank positions, health and active flags in id order and of the live rockets
+     */
+    uint64_t HashState() const;
+
+    /**
+     * Write HashState to a file every interval frames, compare two of these files with FirstDivergentFrame
+     */
+    void StartHashing(const std::string& path, int interval);
+
     void Draw();
 
     void Tick(float deltaTime);
@@ -54,39 +170,166 @@ class Game
         /* implement if you want to handle keys */
     }
 
-    void KeyDown(int key)
-    {
-        /* implement if you want to handle keys */
-    }
+    void KeyDown(int key);
+
+    long long GetFrameCount() const { return frame_count; }
+
+    const std::vector<Tank>& GetTanks() const { return tanks; }
+
+    const std::vector<Particle_beam>& GetParticleBeams() const { return particle_beams; }
+
+    PhaseTimer& GetPhaseTimer() { return phase_timer; }
+
+    const PhaseTimer& GetPhaseTimer() const { return phase_timer; }
 
   private:
-    SDL_Renderer* screen;
+    SDL_Renderer* screen = nullptr;
     std::vector<Tank> tanks;
     std::vector<Tank*> blueTanks;
     std::vector<Tank*> redTanks;
+    //Index in tanks of the tank with every id, hashes, replays and the spawns of the deterministic mode go in this order
+    std::vector<uint32_t> tank_slots;
+    //Every tank from here to the end of tanks is destroyed, CompactTanks moves the wrecks behind it
+    size_t live_tanks = 0;
+    //Size of the armies at the start, the tank lists only keep the tanks that are left
+    size_t num_blue_tanks = 0;
+    size_t num_red_tanks = 0;
     std::vector<Rocket> rockets;
     std::vector<Smoke> smokes;
     std::vector<Explosion> explosions;
     std::vector<Particle_beam> particle_beams;
 
-    KD_Tree* red_KD_Tree;
-    KD_Tree* blue_KD_Tree;
+    KD_Tree* red_KD_Tree = nullptr;
+    KD_Tree* blue_KD_Tree = nullptr;
+
+    std::unique_ptr<Grid> grid;
+
+    //Guards the rocket and smoke vectors while the tank loop spawns into them
+    std::mutex tankVectorMutex;
+
+    std::vector<int> redHealthBars;
+    std::vector<int> blueHealthBars;
+    std::vector<SDL_Point> drawPoints;
+
+    BattleParameters parameters;
+
+    PhaseTimer phase_timer;
+
+    std::unique_ptr<ReplayRecorder> recorder;
+
+    std::unique_ptr<StateHashLog> hash_log;
+
+    //The phases of Update as a dependency graph, built on the first frame
+    std::unique_ptr<tbb::flow::graph> update_graph;
+    std::unique_ptr<tbb::flow::broadcast_node<tbb::flow::continue_msg>> update_start;
+    std::vector<std::unique_ptr<tbb::flow::continue_node<tbb::flow::continue_msg>>> update_nodes;
+
+    //Everything behind these indices was spawned this frame, used for recording replays
+    size_t first_smoke = 0;
+    size_t first_explosion = 0;
+    size_t first_rocket = 0;
 
     //Font *frame_count_font;
+    FC_Font* font = nullptr;
     long long frame_count = 0;
 
+    timer perf_timer;
+    float duration = 0.f;
+
     bool lock_update = false;
 
+    bool deterministic = false;
+    uint64_t seed = 0;
+
+    std::unique_ptr<AffinityObserver> affinity;
+    bool numa = false;
+
+    Formation blue_formation;
+    Formation red_formation;
+
+    //SortTanks every this many frames, 0 never
+    int sort_interval = 0;
+    //SortTanks builds the new order here and swaps it with the tanks, so sorting again does not allocate
+    std::vector<Tank> sorted_tanks;
+    //The new index of every tank is its place in sort_order, the live tanks come first
+    std::vector<uint32_t> sort_order;
+    std::vector<uint32_t> sort_slots;
+
+    float neighbour_skin = 0.f;
+    std::unique_ptr<NeighbourList> neighbours;
+
+    //What the parallel passes of the deterministic mode spawn, applied in index order afterwards
+    struct TankSpawns
+    {
+        bool updated = false;
+        int smokes = 0;
+        vec2<> smoke_position;
+        Tank* target = nullptr;
+    };
+
+    struct RocketHits
+    {
+        Tank* tanks[9]; // at most one per neighbouring grid cell
+        int count = 0;
+    };
+
+    std::vector<TankSpawns> tank_spawns;
+    std::vector<RocketHits> rocket_hits;
+
+    //What the rocket collision of a column of cells spawns, added to the game in column order afterwards
+    struct ColumnHits
+    {
+        std::vector<uint32_t> rockets;
+        std::vector<vec2<>> explosions;
+        std::vector<vec2<>> smokes;
+    };
+
+    std::vector<ColumnHits> column_hits;
+
+    //Tanks that drove into another cell while their column was updated, moved in the grid after all columns are done
+    std::vector<std::vector<Tank*>> column_moves;
+
+    //Ranges of equal estimated cost for the tank and rocket loops, rebuilt every frame as the battle moves
+    CostPartition tank_partition;
+    CostPartition rocket_partition;
+    CostPartition column_partition;
+
+    void PartitionTanks();
+
+    void PartitionRockets();
+
     void UpdateTanks();
 
+    void UpdateTanksDeterministic();
+
+    void UpdateTanksByColumn();
+
+    void AimTanksDeterministic();
+
     void UpdateSmoke();
 
     void UpdateRockets();
 
+    void UpdateRocketsDeterministic();
+
+    void CollideRocketsByCell();
+
     void UpdateParticleBeams();
 
     void UpdateExplosions();
 
-    ~Game();
+    void LoadSprites();
+
+    void PlaceMemory();
+
+    void SortTanks();
+
+    void RemoveDestroyedTanks();
+
+    void CompactTanks();
+
+    void ReorderTanks();
+
+    void BuildUpdateGraph();
 };
 }; // namespace PP2
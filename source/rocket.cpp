@@ -4,9 +4,9 @@
 
 namespace PP2
 {
-Rocket::Rocket(vec2<> position, vec2<> direction, float collision_radius, alliances allignment, SDL_Texture* rocket_sprite)
+Rocket::Rocket(vec2<> position, vec2<> direction, float collision_radius, alliances allignment, SDL_Texture* rocket_sprite, int id)
     : position(position), speed(direction), collision_radius(collision_radius), allignment(allignment),
-      current_frame(0), rocket_sprite(rocket_sprite), active(true), id(rand())
+      current_frame(0), rocket_sprite(rocket_sprite), active(true), id(id)
 {
     SrcR = {0, 0, R_SIZE, R_SIZE};
     DestR = {0, 0, R_SIZE, R_SIZE};
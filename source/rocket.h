@@ -2,13 +2,14 @@
 
 #include "template.h"
 #include <SDL2/SDL_render.h>
+#include <cstdlib>
 
 namespace PP2
 {
 class Rocket
 {
   public:
-    Rocket(vec2<> position, vec2<> direction, float collision_radius, alliances allignment, SDL_Texture* rocket_sprite);
+    Rocket(vec2<> position, vec2<> direction, float collision_radius, alliances allignment, SDL_Texture* rocket_sprite, int id = rand());
 
     ~Rocket();
 
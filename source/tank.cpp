@@ -41,7 +41,17 @@ Tank::Tank(
 
 Tank::~Tank() = default;
 
-void Tank::Tick()
+void Tank::Tick(Grid& grid)
+{
+    if (!Move()) return;
+
+    //Move tank to the new grid cell
+    auto newGridCell = Grid::GetGridCell(position);
+    grid.MoveTankToGridCell(this, newGridCell);
+    gridCell = newGridCell;
+}
+
+bool Tank::Move()
 {
     vec2<> direction = (target - position).normalized();
 
@@ -52,18 +62,11 @@ void Tank::Tick()
     //Update reload time
     if (--reload_time <= 0.0f) { reloaded = true; }
 
-    auto newGridCell = Grid::GetGridCell(position);
-    if (gridCell != newGridCell)
-    {
-        //Move tank to the new grid cell
-        Grid::Instance()->MoveTankToGridCell(this, newGridCell);
-        //Update grid cell
-        gridCell = Grid::GetGridCell(position);
-    }
-
     force = vec2(0.f, 0.f);
 
     if (++current_frame > 8) current_frame = 0;
+
+    return gridCell != Grid::GetGridCell(position);
 }
 
 //Start reloading timer
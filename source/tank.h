@@ -5,6 +5,8 @@
 
 namespace PP2
 {
+class Grid;
+
 class Tank
 {
   public:
@@ -13,7 +15,16 @@ class Tank
 
     ~Tank();
 
-    void Tick();
+    /**
+     * Move the tank and keep its cell in the grid of its game up to date
+     */
+    void Tick(Grid& grid);
+
+    /**
+     * Move the tank like Tick but leave the grid alone
+     * @return True when the tank drove into another cell, gridCell still holds the old one
+     */
+    bool Move();
 
     vec2<> Get_Position() const { return position; };
 
@@ -33,6 +44,9 @@ class Tank
 
     void Push(const vec2<float>& direction, float magnitude);
 
+    //Index the tank was spawned at, it keeps its id when Game reorders the tanks in memory
+    uint32_t id = 0;
+
     vec2<float> position;
     vec2<int> gridCell;
     vec2<float> speed;
@@ -13,6 +13,8 @@
 
 #include "template.h"
 #include "defines.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
 #include "game.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
@@ -153,6 +155,64 @@ int main(int argc, char** argv)
     redirectIO();
 #endif
     printf("application started.\n");
+
+    // --trace <file> [--trace-start <frame>] [--trace-frames <count>] writes a Chrome trace of a window of frames
+    // --counters prints hardware performance counters per phase on exit
+    // --record <file> [--record-keyframes <interval>] writes a replay of the battle, compressed when given a keyframe interval
+    // --checkpoint <file> starts from a checkpoint saved with the C key
+    // --deterministic <seed> gives the same battle for any thread count
+    // --hash <file> [--hash-every <frames>] writes a hash of the battle state every few frames (default 10)
+    // --pin <cores|nodes> pins the worker threads, --numa also places the simulation data on the node of its threads
+    // --formation <block|ring|wedge|scatter> sets how both armies are lined up at the start
+    // --sort-every <frames> reorders the tanks in memory by grid cell every few frames
+    // --skin <pixels> separates the tanks from neighbour lists that are rebuilt once a tank moved half the skin
+    // --build-asset-pack <file> converts the sprites to an asset pack and exits, the game loads assets/sprites.pack
+    // --compare-hashes <file> <file> reports the first frame where two hash files differ and exits
+    std::string trace_path, record_path, checkpoint_path;
+    long long trace_start = 100, trace_frames = 20;
+    int record_keyframes = 0;
+    long long deterministic_seed = -1;
+    std::string hash_path;
+    int hash_every = 10;
+    Pinning pinning = Pinning::NONE;
+    bool numa = false;
+    std::string formation;
+    int sort_every = 0;
+    float skin = 0.f;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--counters")) PerfCounters::Instance()->Enable();
+        if (!strcmp(argv[i], "--numa")) numa = true;
+        if (!strcmp(argv[i], "--compare-hashes") && i + 2 < argc)
+        {
+            size_t compared = 0;
+            long long frame = FirstDivergentFrame(argv[i + 1], argv[i + 2], &compared);
+            if (frame == -2)
+                printf("the hash files could not be compared\n");
+            else if (frame == -1)
+                printf("%zu hashed frames are identical\n", compared);
+            else
+                printf("the runs diverge at frame %lld\n", frame);
+            return frame == -1 ? 0 : 1;
+        }
+        if (i + 1 == argc) break;
+        if (!strcmp(argv[i], "--build-asset-pack")) return Game::BuildAssetPack(argv[i + 1]) ? 0 : 1;
+        if (!strcmp(argv[i], "--trace")) trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--record")) record_path = argv[++i];
+        else if (!strcmp(argv[i], "--checkpoint")) checkpoint_path = argv[++i];
+        else if (!strcmp(argv[i], "--hash")) hash_path = argv[++i];
+        else if (!strcmp(argv[i], "--hash-every")) hash_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--deterministic")) deterministic_seed = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--pin")) pinning = !strcmp(argv[++i], "nodes") ? Pinning::NODES : Pinning::CORES;
+        else if (!strcmp(argv[i], "--formation")) formation = argv[++i];
+        else if (!strcmp(argv[i], "--sort-every")) sort_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--skin")) skin = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--record-keyframes")) record_keyframes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trace-start")) trace_start = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--trace-frames")) trace_frames = atoll(argv[++i]);
+    }
+    if (!trace_path.empty()) Tracer::Instance()->Configure(trace_path, trace_start, trace_frames);
+
     SDL_Init(SDL_INIT_VIDEO);
 
     TTF_Init();
@@ -173,7 +233,19 @@ int main(int argc, char** argv)
     int exitapp = 0;
     game = new Game();
     game->SetTarget(renderer);
+    if (deterministic_seed >= 0) game->SetDeterministic(true, deterministic_seed);
+    if (pinning != Pinning::NONE || numa) game->SetPlacement(pinning, numa);
+    game->SetSortInterval(sort_every);
+    game->SetNeighbourSkin(skin);
+    if (!formation.empty())
+    {
+        uint64_t seed = deterministic_seed >= 0 ? deterministic_seed : 0;
+        game->SetFormations(NamedFormation(formation, BLUE, seed), NamedFormation(formation, RED, seed));
+    }
     game->Init();
+    if (!checkpoint_path.empty()) game->LoadCheckpoint(checkpoint_path);
+    if (!record_path.empty()) game->StartRecording(record_path, record_keyframes);
+    if (!hash_path.empty()) game->StartHashing(hash_path, hash_every);
     timer t;
     t.reset();
     while (!exitapp)
@@ -184,13 +256,16 @@ int main(int argc, char** argv)
         // calculate frame time and pass it to game->Tick
         game->Tick(t.elapsed());
         t.reset();
+        {
 #ifdef USING_EASY_PROFILER
-        EASY_BLOCK("SDL_RenderPresent", profiler::colors::Green);
+            EASY_BLOCK("SDL_RenderPresent", profiler::colors::Green);
 #endif
-        SDL_RenderPresent(renderer);
+            ScopedPhaseTimer present(game->GetPhaseTimer(), PHASE_RENDER_PRESENT);
+            SDL_RenderPresent(renderer);
 #ifdef USING_EASY_PROFILER
-        EASY_END_BLOCK;
+            EASY_END_BLOCK;
 #endif
+        }
         // event loop
         SDL_Event event;
         while (SDL_PollEvent(&event))